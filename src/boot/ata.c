@@ -0,0 +1,54 @@
+#include <inc/x86.h>
+
+#include <boot/boot.h>
+
+/**
+ * Polled PIO access to the first IDE hard disk, linked into both stages
+ * of the boot loader.
+ */
+
+void waitdisk(void) {
+    // wait for disk reaady
+    while ((inb(0x1F7) & 0xC0) != 0x40)
+        /* do nothing */;
+}
+
+// Read 'nsects' sectors starting at sector 'lba' into physical address
+// 'pa' using the read command 'cmd': 0x20 (read sectors), or 0xc4 (read
+// multiple) once setmultiple() in loader.c has set the drive up for it.
+void readsects(uint32_t pa, uint32_t lba, uint32_t nsects, uint32_t cmd) {
+    uint32_t n;
+
+    // Issue one command per run of up to MAXSECTS sectors rather than
+    // one per sector.
+    while (nsects > 0) {
+        n = nsects;
+        if (n > MAXSECTS)
+            n = MAXSECTS;
+        nsects -= n;
+
+        // wait for disk to be ready
+        waitdisk();
+
+        outb(0x1F2, n);     // count; 0 means 256
+        outb(0x1F3, lba);
+        outb(0x1F4, lba >> 8);
+        outb(0x1F5, lba >> 16);
+        outb(0x1F6, (lba >> 24) | 0xE0);
+        outb(0x1F7, cmd);
+        lba += n;
+
+        // The drive raises DRQ once per block; polling between the
+        // sectors of a READ MULTIPLE block falls straight through.
+        for (; n > 0; n--) {
+            waitdisk();
+
+            // Since we haven't enabled paging yet and we're using
+            // an identity segment mapping (see boot.S), we can
+            // use physical addresses directly.  This won't be the
+            // case once POS enables the MMU.
+            insl(0x1F0, (uint8_t*) pa, SECTSIZE/4);
+            pa += SECTSIZE;
+        }
+    }
+}
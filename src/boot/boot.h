@@ -0,0 +1,57 @@
+#ifndef _POTATOS_BOOT_BOOT_H_
+#define _POTATOS_BOOT_BOOT_H_
+
+#include <inc/types.h>
+
+/**
+ * Definitions shared by the two stages of the boot loader.
+ *
+ * STAGE2SECTS, the number of sectors set aside for stage 2, comes from
+ * src/boot/Makefrag so the disk image and the loader agree on it.
+ */
+
+#define SECTSIZE    512
+#define MAXSECTS    256     // most sectors a single ATA command can move
+#define MULTSECTS   16      // sectors per DRQ block asked of the drive
+
+// Sector 1 holds the boot manifest and stage 2 follows it; the boot
+// sector reads both in with one command, to MANIFEST.  The kernel's
+// data starts after that.
+#define MANIFEST    0x7e00
+#define STAGE2      (MANIFEST + SECTSIZE)
+#define KERNSECT    (2 + STAGE2SECTS)
+
+// The boot manifest, written by mkimage.py: where each piece of the
+// kernel is on disk and where it goes in memory, so stage 2 can load the
+// kernel without reading or parsing its ELF headers.  Extents are in
+// disk order, back to back from KERNSECT on.
+#define MANIFEST_MAGIC  0x464e4d50  // "PMNF"
+#define MF_LZ4          0x1         // extents are stored LZ4-compressed
+#define MF_MAXEXTENTS   ((SECTSIZE - sizeof(struct Manifest)) / sizeof(struct Extent))
+
+struct Manifest {
+    uint32_t mf_magic;      // must equal MANIFEST_MAGIC
+    uint32_t mf_flags;      // MF_*
+    uint32_t mf_entry;      // kernel entry point
+    uint32_t mf_nextents;   // number of struct Extent that follow
+    uint32_t mf_stage;      // MF_LZ4: where to read the compressed data
+};
+
+struct Extent {
+    uint32_t ex_lba;        // first sector on disk
+    uint32_t ex_nsects;     // sectors on disk
+    uint32_t ex_pa;         // load address
+    uint32_t ex_size;       // bytes the stored data fills from ex_pa
+    uint32_t ex_csize;      // MF_LZ4: bytes of compressed data at ex_lba
+    uint32_t ex_zero;       // bytes to clear after those (BSS)
+};
+
+// ata.c
+void waitdisk(void);
+void readsects(uint32_t pa, uint32_t lba, uint32_t nsects, uint32_t cmd);
+
+// dma.c (stage 2 only)
+int dmainit(void);
+int dmaread(uint32_t pa, uint32_t lba, uint32_t nsects);
+
+#endif  // !_POTATOS_BOOT_BOOT_H_
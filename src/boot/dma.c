@@ -0,0 +1,169 @@
+#include <inc/x86.h>
+
+#include <boot/boot.h>
+
+/**
+ * Bus-master IDE DMA for the second stage of the boot loader.
+ *
+ * dmainit() looks on PCI bus 0 for an IDE controller that can master the
+ * bus (the PIIX under QEMU) and whose primary channel sits at the legacy
+ * ports ata.c polls.  dmaread() then streams runs of sectors through two
+ * 64KB bounce buffers: while the drive fills one, the CPU places the
+ * other at its load address.
+ */
+
+// PCI configuration mechanism #1
+#define PCI_ADDR        0xCF8
+#define PCI_DATA        0xCFC
+
+#define PCI_ID          0x00    // device and vendor ID
+#define PCI_CMD         0x04    // command register
+#define PCI_CMD_IO      0x0001  // respond to I/O space accesses
+#define PCI_CMD_MASTER  0x0004  // allow bus mastering
+#define PCI_CLASS       0x08    // class, subclass, prog-if, revision
+#define PCI_BAR4        0x20    // bus-master IDE register block
+
+#define PCI_CLASS_IDE   0x0101  // mass storage, IDE
+#define IDE_IF_NATIVE   0x01    // prog-if: primary channel in native mode
+#define IDE_IF_MASTER   0x80    // prog-if: bus-master capable
+
+// Bus-master IDE registers of the primary channel, relative to BAR4
+#define BMICOM          0       // command
+#define BMICOM_START    0x01    // start/stop bus master
+#define BMICOM_READ     0x08    // transfer from the drive into memory
+#define BMISTA          2       // status
+#define BMISTA_ACTIVE   0x01    // transfer in progress
+#define BMISTA_ERR      0x02    // transfer failed (write 1 to clear)
+#define BMISTA_INTR     0x04    // drive raised its interrupt (write 1 to clear)
+#define BMIDTP          4       // physical address of the PRD table
+
+// Bounce buffers.  A PRD entry may not cross a 64KB boundary, so each
+// buffer is one aligned 64KB region described by a single entry.
+#define DMABUFSIZE      0x10000
+#define DMASECTS        (DMABUFSIZE / SECTSIZE)
+#define DMABUF(i)       (0x20000 + (i) * DMABUFSIZE)
+
+// Physical region descriptor
+struct Prd {
+    uint32_t prd_addr;      // physical address of the region
+    uint16_t prd_count;     // byte count, 0 meaning 64KB
+    uint16_t prd_flags;
+};
+#define PRD_EOT         0x8000  // last entry of the table
+
+static struct Prd prdt[2] __attribute__((aligned(8)));
+static uint32_t bmbase;
+
+static uint32_t pciread(uint32_t dev, uint32_t func, uint32_t reg) {
+    outl(PCI_ADDR, 0x80000000 | (dev << 11) | (func << 8) | reg);
+    return inl(PCI_DATA);
+}
+
+static void pciwrite(uint32_t dev, uint32_t func, uint32_t reg, uint32_t v) {
+    outl(PCI_ADDR, 0x80000000 | (dev << 11) | (func << 8) | reg);
+    outl(PCI_DATA, v);
+}
+
+// Find a bus-master IDE controller and turn on its bus mastering.
+// Returns 1 if DMA can be used, 0 if the caller should stick to PIO.
+int dmainit(void) {
+    uint32_t dev, func, class;
+
+    for (dev = 0; dev < 32; dev++) {
+        for (func = 0; func < 8; func++) {
+            if ((pciread(dev, func, PCI_ID) & 0xffff) == 0xffff)
+                continue;
+
+            class = pciread(dev, func, PCI_CLASS);
+            if ((class >> 16) != PCI_CLASS_IDE ||
+                (class & (IDE_IF_MASTER << 8)) == 0 ||
+                (class & (IDE_IF_NATIVE << 8)) != 0)
+                continue;
+
+            bmbase = pciread(dev, func, PCI_BAR4) & ~3;
+            if (bmbase == 0)
+                continue;
+
+            pciwrite(dev, func, PCI_CMD, pciread(dev, func, PCI_CMD)
+                     | PCI_CMD_IO | PCI_CMD_MASTER);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Start reading 'nsects' (at most DMASECTS) sectors at sector 'lba'
+// into bounce buffer 'buf'.
+static void dmastart(int buf, uint32_t lba, uint32_t nsects) {
+    prdt[buf].prd_addr = DMABUF(buf);
+    prdt[buf].prd_count = nsects * SECTSIZE;
+    prdt[buf].prd_flags = PRD_EOT;
+
+    // wait for disk to be ready
+    waitdisk();
+
+    outb(bmbase + BMICOM, 0);
+    outl(bmbase + BMIDTP, (uint32_t) &prdt[buf]);
+    outb(bmbase + BMISTA, BMISTA_ERR | BMISTA_INTR);
+    outb(bmbase + BMICOM, BMICOM_READ);
+
+    outb(0x1F2, nsects);
+    outb(0x1F3, lba);
+    outb(0x1F4, lba >> 8);
+    outb(0x1F5, lba >> 16);
+    outb(0x1F6, (lba >> 24) | 0xE0);
+    outb(0x1F7, 0xC8);  // cmd 0xc8 - read DMA
+
+    outb(bmbase + BMICOM, BMICOM_READ | BMICOM_START);
+}
+
+// Wait for the transfer dmastart() began.  Returns 0 on success, -1 if
+// either the bus master or the drive reported an error.
+static int dmawait(void) {
+    uint8_t st;
+
+    do {
+        st = inb(bmbase + BMISTA);
+    } while ((st & (BMISTA_ACTIVE | BMISTA_ERR | BMISTA_INTR))
+             == BMISTA_ACTIVE);
+
+    outb(bmbase + BMICOM, 0);
+    outb(bmbase + BMISTA, BMISTA_ERR | BMISTA_INTR);
+
+    // reading the drive's status also acknowledges its interrupt
+    if ((st & BMISTA_ERR) || (inb(0x1F7) & 0x21))
+        return -1;
+    return 0;
+}
+
+// Read 'nsects' sectors starting at sector 'lba' into physical address
+// 'pa'.  Returns 0 on success, or -1 if a transfer failed, in which case
+// the caller should read the whole run again with PIO.
+int dmaread(uint32_t pa, uint32_t lba, uint32_t nsects) {
+    uint32_t n, next;
+    int buf;
+
+    if (nsects == 0)
+        return 0;
+
+    n = MIN(nsects, DMASECTS);
+    dmastart(0, lba, n);
+
+    for (buf = 0; n > 0; buf ^= 1) {
+        if (dmawait() < 0)
+            return -1;
+        nsects -= n;
+        lba += n;
+
+        // queue the next chunk into the other buffer, then place this
+        // one while the drive works on it
+        next = MIN(nsects, DMASECTS);
+        if (next > 0)
+            dmastart(buf ^ 1, lba, next);
+
+        movsl((void*) pa, (void*) DMABUF(buf), n * SECTSIZE / 4);
+        pa += n * SECTSIZE;
+        n = next;
+    }
+    return 0;
+}
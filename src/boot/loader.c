@@ -0,0 +1,163 @@
+#include <inc/x86.h>
+#include <inc/mmu.h>
+#include <inc/lz4.h>
+#include <inc/bootinfo.h>
+
+#include <boot/boot.h>
+
+/**
+ * Second stage of the boot loader.  bootmain() in main.c loads this
+ * from the sectors after the boot sector, which leaves it room for more
+ * than the 510 bytes the first stage has to work with.
+ *
+ * loadmain() loads the kernel as the boot manifest that came in with it
+ * describes (see struct Manifest in boot.h and mkimage.py): one read per
+ * extent, in disk order, then the zero-filled tails.  The extents are
+ * either raw sectors or, when built with KERN_COMPRESS=lz4, LZ4 blocks
+ * that are expanded into place.  It uses bus-master DMA (see dma.c) when
+ * there is a controller for it, and polled PIO otherwise.
+ */
+
+#define MF ((struct Manifest *) MANIFEST)
+
+void loadraw(struct Extent *, struct Extent *);
+int loadlz4(struct Extent *, struct Extent *);
+uint32_t setmultiple(void);
+void readrun(uint32_t, uint32_t, uint32_t);
+void zeroseg(uint32_t, uint32_t);
+void stamp(uint32_t, uint32_t);
+
+static uint32_t readcmd;    // PIO read command picked by setmultiple()
+static int usedma;
+
+
+void loadmain(void) {
+    struct Bootinfo *bi = (struct Bootinfo *) BOOTINFO;
+    struct Extent *ex, *eex;
+
+    // keep what boot.S put there: its reset and A20 timestamps, the E820
+    // map and the A20 method
+    stosb(&bi->bi_nstamps, 0,
+          sizeof(*bi) - offsetof(struct Bootinfo, bi_nstamps));
+    bi->bi_magic = BOOTINFO_MAGIC;
+    bi->bi_stamps[0].bs_what = BS_RESET;
+    bi->bi_stamps[0].bs_arg = 0;
+    bi->bi_stamps[1].bs_what = BS_A20;
+    bi->bi_stamps[1].bs_arg = bi->bi_a20;
+    bi->bi_nstamps = 2;
+    stamp(BS_STAGE2, 0);
+
+    // The boot sector left the drive in single-sector mode; ask it for
+    // bigger blocks for the kernel.
+    readcmd = setmultiple();
+    usedma = dmainit();
+
+    if (MF->mf_magic != MANIFEST_MAGIC || MF->mf_nextents == 0)
+        goto bad;
+    ex = (struct Extent *) (MF + 1);
+    eex = ex + MIN(MF->mf_nextents, MF_MAXEXTENTS);
+
+    if (MF->mf_flags & MF_LZ4) {
+        if (loadlz4(ex, eex) < 0)
+            goto bad;
+    } else
+        loadraw(ex, eex);
+
+    // Clear what the image doesn't store (BSS) only after every read is
+    // done, since DMA may still be placing the last of them.
+    for (; ex < eex; ex++)
+        zeroseg(ex->ex_pa + ex->ex_size, ex->ex_zero);
+    stamp(BS_BSS, 0);
+
+    // call the kernel's entry point, handing it the Bootinfo block the
+    // way a Multiboot loader hands over its info: magic in %eax and
+    // address in %ebx
+    // note: does not return!
+    stamp(BS_KERNEL, MF->mf_entry);
+    __asm __volatile("jmp *%0" : : "r" (MF->mf_entry),
+                     "a" (BOOTINFO_MAGIC), "b" (BOOTINFO));
+
+bad:
+    outw(0xBA00, 0x8A00);
+    outw(0x8A00, 0x8E00);
+    while (1)
+        /* do nothing */;
+}
+
+// Read each extent's sectors straight into its load address.
+void loadraw(struct Extent *ex, struct Extent *eex) {
+    for (; ex < eex; ex++) {
+        readrun(ex->ex_pa, ex->ex_lba, ex->ex_nsects);
+        stamp(BS_SEGMENT, ex->ex_pa);
+    }
+}
+
+// Stream all of the compressed extents in with one read, to mf_stage,
+// then expand each into its load address.
+// Returns 0, or -1 if a block fails to expand.
+int loadlz4(struct Extent *ex, struct Extent *eex) {
+    struct Bootinfo *bi = (struct Bootinfo *) BOOTINFO;
+    uint32_t first = ex->ex_lba;
+    uint64_t start;
+
+    readrun(MF->mf_stage, first, eex[-1].ex_lba + eex[-1].ex_nsects - first);
+    stamp(BS_SEGMENT, MF->mf_stage);
+
+    start = read_tsc();
+    for (; ex < eex; ex++) {
+        if (lz4_decompress((void*) ex->ex_pa, ex->ex_size,
+                           (void*) (MF->mf_stage + (ex->ex_lba - first) * SECTSIZE),
+                           ex->ex_csize)
+            != ex->ex_size)
+            return -1;
+        bi->bi_lz4_csize += ex->ex_csize;
+        bi->bi_lz4_usize += ex->ex_size;
+    }
+    bi->bi_lz4_cycles = read_tsc() - start;
+    stamp(BS_LZ4, 0);
+    return 0;
+}
+
+// Read 'nsects' sectors starting at 'lba' into physical address 'pa'.
+void readrun(uint32_t pa, uint32_t lba, uint32_t nsects) {
+    // if DMA fails, give up on it and redo the whole run with PIO
+    if (usedma && dmaread(pa, lba, nsects) == 0)
+        return;
+    usedma = 0;
+    readsects(pa, lba, nsects, readcmd);
+}
+
+// Ask the drive for MULTSECTS sectors per data request.
+// Returns the read command to use: 0xc4 (read multiple) if the drive took
+// it, or 0x20 (read sectors) if it aborted the request.
+uint32_t setmultiple(void) {
+    waitdisk();
+
+    outb(0x1F2, MULTSECTS);
+    outb(0x1F6, 0xE0);
+    outb(0x1F7, 0xC6);  // cmd 0xc6 - set multiple mode
+
+    // an aborted command leaves ERR set in the status register
+    waitdisk();
+    return (inb(0x1F7) & 0x01) ? 0x20 : 0xC4;
+}
+
+// Append a timestamp marking the end of boot phase 'what' to the
+// Bootinfo timeline.
+void stamp(uint32_t what, uint32_t arg) {
+    struct Bootinfo *bi = (struct Bootinfo *) BOOTINFO;
+    struct Bootstamp *bs;
+
+    if (bi->bi_nstamps == BOOTINFO_NSTAMPS)
+        return;
+    bs = &bi->bi_stamps[bi->bi_nstamps++];
+    bs->bs_tsc = read_tsc();
+    bs->bs_what = what;
+    bs->bs_arg = arg;
+}
+
+// Zero 'count' bytes at physical address 'pa', a dword at a time.
+void zeroseg(uint32_t pa, uint32_t count) {
+    stosl((void*) pa, 0, count / 4);
+    stosb((void*) (pa + (count & ~3)), 0, count & 3);
+}
@@ -0,0 +1,199 @@
+#!/usr/bin/env python
+"""Build the boot disk image.
+
+    mkimage.py [--lz4] STAGE2_SECTS boot stage2 kernel image
+
+Lays out the disk the way src/boot/main.c describes it: the signed boot
+sector, the boot manifest, stage 2, and then the kernel's loadable
+segments, grouped into extents that stage 2 reads straight into place
+(or, with --lz4, expands into place).  The manifest matches
+struct Manifest and struct Extent in src/boot/boot.h.
+
+Before writing anything it replays the manifest the way stage 2 will
+and checks the result against the kernel's ELF program headers.
+"""
+from __future__ import print_function
+import struct
+import sys
+
+from mklz4 import lz4_compress, lz4_decompress
+
+SECTSIZE = 512
+PGSIZE = 4096
+IMAGESECTS = 10000              # pad the image to at least this
+
+MANIFEST_MAGIC = 0x464e4d50
+MF_LZ4 = 0x1
+MANIFEST = struct.Struct('<5I')
+EXTENT = struct.Struct('<6I')
+MF_MAXEXTENTS = (SECTSIZE - MANIFEST.size) // EXTENT.size
+
+# Segments closer together than this share an extent: reading the gap
+# costs less than another disk command.
+MERGEGAP = 4 * SECTSIZE
+
+ELF_MAGIC = b'\x7fELF'
+ELF_PROG_LOAD = 1
+
+
+def die(msg):
+    print('mkimage: %s' % msg, file=sys.stderr)
+    exit(1)
+
+
+def roundup(n, align):
+    return (n + align - 1) // align * align
+
+
+def rounddown(n, align):
+    return n // align * align
+
+
+def load_segments(elf):
+    if elf[:4] != ELF_MAGIC:
+        die('kernel is not an ELF file')
+
+    entry, phoff = struct.unpack_from('<II', elf, 24)
+    phentsize, phnum = struct.unpack_from('<HH', elf, 42)
+    segs = []
+    for i in range(phnum):
+        (p_type, p_offset, p_va, p_pa, p_filesz, p_memsz, p_flags,
+         p_align) = struct.unpack_from('<8I', elf, phoff + i * phentsize)
+        if p_type == ELF_PROG_LOAD and p_memsz:
+            if p_filesz > p_memsz:
+                die('segment at 0x%x: filesz > memsz' % p_pa)
+            segs.append((p_pa, p_memsz, elf[p_offset:p_offset + p_filesz]))
+
+    segs.sort()
+    for (pa, memsz, _), (npa, _, _) in zip(segs, segs[1:]):
+        if pa + memsz > npa:
+            die('segments at 0x%x and 0x%x overlap' % (pa, npa))
+    return entry, segs
+
+
+def group_segments(segs, align):
+    """Group the segments into runs to load as one extent each.
+
+    Returns (pa, data, end) tuples: the run's load address rounded down to
+    'align', its memory image up to the end of the last file data, and
+    the end of its memory.
+    """
+    runs = []
+    for pa, memsz, data in segs:
+        start = rounddown(pa, align)
+        if runs and start < roundup(runs[-1][0] + len(runs[-1][1]), align) + MERGEGAP:
+            rpa, rdata, _ = runs[-1]
+        else:
+            rpa, rdata = start, bytearray()
+            runs.append(None)
+        rdata += b'\0' * (pa - rpa - len(rdata)) + data
+        runs[-1] = (rpa, rdata, pa + memsz)
+    return [(pa, bytes(data), end) for pa, data, end in runs]
+
+
+def build_extents(segs, kernsect, lz4):
+    """Lay the segments out on disk from sector 'kernsect' on.
+
+    Returns the extent table (a list of dicts) and the disk data.
+    """
+    extents = []
+    disk = b''
+    # raw sectors land whole, so a raw run must start on a sector
+    for pa, data, end in group_segments(segs, 1 if lz4 else SECTSIZE):
+        if lz4:
+            stored = lz4_compress(data)
+            size = len(data)
+        else:
+            stored = data
+            size = roundup(len(data), SECTSIZE)
+        nsects = roundup(len(stored), SECTSIZE) // SECTSIZE
+        extents.append(dict(lba=kernsect + len(disk) // SECTSIZE,
+                            nsects=nsects, pa=pa, size=size,
+                            csize=len(stored) if lz4 else 0,
+                            zero=max(0, end - (pa + size))))
+        disk += stored + b'\0' * (nsects * SECTSIZE - len(stored))
+    return extents, disk
+
+
+def check(extents, disk, kernsect, stage, segs, lz4):
+    """Replay the extents as stage 2 will and compare with the ELF."""
+    lo = min(ex['pa'] for ex in extents)
+    hi = max(ex['pa'] + ex['size'] + ex['zero'] for ex in extents)
+    mem = bytearray(b'\xcc' * (hi - lo))
+
+    for ex in extents:
+        off = (ex['lba'] - kernsect) * SECTSIZE
+        stored = disk[off:off + ex['nsects'] * SECTSIZE]
+        if lz4:
+            if stage < hi:
+                die('LZ4 staging area overlaps the kernel')
+            data = lz4_decompress(stored[:ex['csize']])
+        else:
+            data = stored
+        if len(data) != ex['size']:
+            die('extent at 0x%x holds %d bytes, not %d'
+                % (ex['pa'], len(data), ex['size']))
+        mem[ex['pa'] - lo:ex['pa'] - lo + ex['size']] = data
+    for ex in extents:
+        start = ex['pa'] + ex['size'] - lo
+        mem[start:start + ex['zero']] = b'\0' * ex['zero']
+
+    for pa, memsz, data in segs:
+        image = bytes(mem[pa - lo:pa - lo + memsz])
+        if image != data + b'\0' * (memsz - len(data)):
+            die('segment at 0x%x does not load as the ELF says' % pa)
+
+
+def main():
+    args = sys.argv[1:]
+    lz4 = args[:1] == ['--lz4']
+    if lz4:
+        args = args[1:]
+    if len(args) != 5:
+        die('usage: mkimage.py [--lz4] STAGE2_SECTS boot stage2 kernel image')
+    stage2sects = int(args[0])
+    kernsect = 2 + stage2sects
+
+    with open(args[1], 'rb') as f:
+        boot = f.read()
+    if len(boot) > 510:
+        die('boot block too large: %d bytes (max 510)' % len(boot))
+    boot += b'\0' * (510 - len(boot)) + b'\x55\xaa'
+
+    with open(args[2], 'rb') as f:
+        stage2 = f.read()
+    if len(stage2) > stage2sects * SECTSIZE:
+        die('stage 2 too large: %d bytes (max %d sectors)'
+            % (len(stage2), stage2sects))
+    stage2 += b'\0' * (stage2sects * SECTSIZE - len(stage2))
+
+    with open(args[3], 'rb') as f:
+        entry, segs = load_segments(f.read())
+    if not segs:
+        die('kernel has no loadable segments')
+
+    extents, disk = build_extents(segs, kernsect, lz4)
+    if len(extents) > MF_MAXEXTENTS:
+        die('too many extents: %d (max %d)' % (len(extents), MF_MAXEXTENTS))
+    end = max(ex['pa'] + ex['size'] + ex['zero'] for ex in extents)
+    stage = roundup(end, PGSIZE) if lz4 else 0
+    check(extents, disk, kernsect, stage, segs, lz4)
+
+    manifest = MANIFEST.pack(MANIFEST_MAGIC, MF_LZ4 if lz4 else 0, entry,
+                             len(extents), stage)
+    for ex in extents:
+        manifest += EXTENT.pack(ex['lba'], ex['nsects'], ex['pa'],
+                                ex['size'], ex['csize'], ex['zero'])
+    manifest += b'\0' * (SECTSIZE - len(manifest))
+
+    image = boot + manifest + stage2 + disk
+    image += b'\0' * max(0, IMAGESECTS * SECTSIZE - len(image))
+    with open(args[4], 'wb') as f:
+        f.write(image)
+
+    usize = sum(len(data) for _, _, data in segs)
+    print('%s: %d extents, %d bytes of kernel in %d sectors'
+          % (args[4], len(extents), usize, len(disk) // SECTSIZE))
+
+if __name__ == '__main__':
+    main()
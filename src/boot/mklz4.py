@@ -0,0 +1,97 @@
+"""LZ4 block compression for mkimage.py.
+
+lz4_compress() writes the raw block format lib/lz4.c expands (no frame
+header or checksums); lz4_decompress() undoes it, so the image builder
+can check what the boot loader will see.
+"""
+import struct
+
+MINMATCH = 4
+MAXOFFSET = 0xffff
+# The block format requires the last match to start at least 12 bytes
+# before the end of the input and the last 5 bytes to be literals.
+MFLIMIT = 12
+LASTLITERALS = 5
+
+
+def _length(out, n):
+    while n >= 255:
+        out.append(255)
+        n -= 255
+    out.append(n)
+
+
+def _sequence(out, literals, offset, mlen):
+    lit = len(literals)
+    token = min(lit, 15) << 4
+    if mlen:
+        token |= min(mlen - MINMATCH, 15)
+    out.append(token)
+    if lit >= 15:
+        _length(out, lit - 15)
+    out.extend(literals)
+    if mlen:
+        out.extend(struct.pack('<H', offset))
+        if mlen - MINMATCH >= 15:
+            _length(out, mlen - MINMATCH - 15)
+
+
+def lz4_compress(src):
+    """Compress src into a single LZ4 block with a greedy hash matcher."""
+    src = bytearray(src)
+    n = len(src)
+    out = bytearray()
+    table = {}
+    anchor = i = 0
+    while i < n - MFLIMIT:
+        key = bytes(src[i:i + MINMATCH])
+        ref = table.get(key)
+        table[key] = i
+        if ref is None or i - ref > MAXOFFSET:
+            i += 1
+            continue
+
+        mlen = MINMATCH
+        limit = n - LASTLITERALS - i
+        while mlen < limit and src[ref + mlen] == src[i + mlen]:
+            mlen += 1
+
+        _sequence(out, src[anchor:i], i - ref, mlen)
+        i += mlen
+        anchor = i
+    _sequence(out, src[anchor:], 0, 0)
+    return bytes(out)
+
+
+def lz4_decompress(src):
+    """Expand a single LZ4 block, as lib/lz4.c does."""
+    src = bytearray(src)
+    out = bytearray()
+    i = 0
+    while i < len(src):
+        token = src[i]
+        i += 1
+        lit = token >> 4
+        if lit == 15:
+            while True:
+                lit += src[i]
+                i += 1
+                if src[i - 1] != 255:
+                    break
+        out += src[i:i + lit]
+        i += lit
+        if i >= len(src):
+            break
+
+        offset = src[i] | src[i + 1] << 8
+        i += 2
+        mlen = token & 15
+        if mlen == 15:
+            while True:
+                mlen += src[i]
+                i += 1
+                if src[i - 1] != 255:
+                    break
+        for _ in range(mlen + MINMATCH):
+            out.append(out[-offset])
+    return bytes(out)
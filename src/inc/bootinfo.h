@@ -0,0 +1,96 @@
+#ifndef _POTATOS_INC_BOOTINFO_H_
+#define _POTATOS_INC_BOOTINFO_H_
+
+/**
+ * The boot loader leaves a struct Bootinfo at physical address BOOTINFO
+ * describing how it booted the kernel.  The page it lives in is not
+ * part of the kernel image, so the kernel has to copy out what it wants
+ * before handing low memory to the page allocator.
+ */
+
+#define BOOTINFO        0x1000
+#define BOOTINFO_MAGIC  0x424f5350  // "PSOB"
+
+// boot.S stores the TSC it reads at reset entry here, before any C code
+// runs; that is bi_stamps[0].bs_tsc.
+#define BOOTINFO_RESETTSC   BOOTINFO
+
+#define BOOTINFO_NSTAMPS    24
+
+// boot.S collects the BIOS memory map (INT 15h, AX=E820h) in real mode,
+// into bi_e820 right after the timestamps, and stores its size in bytes
+// at bi_e820size.
+#define BOOTINFO_E820SIZE   (BOOTINFO + BOOTINFO_NSTAMPS * 16)
+#define BOOTINFO_E820MAP    (BOOTINFO_E820SIZE + 4)
+#define BOOTINFO_E820MAX    32      // entries
+#define E820_ENTSIZE        20      // bytes per entry, as the BIOS writes it
+#define E820_SMAP           0x534d4150  // "SMAP"
+
+// E820 address range types
+#define E820_RAM            1       // usable RAM
+#define E820_RESERVED       2
+#define E820_ACPI           3       // ACPI tables, reclaimable once read
+#define E820_NVS            4       // ACPI non-volatile storage
+#define E820_BAD            5       // defective RAM
+
+// boot.S enables A20 and records how at bi_a20, and when in the second
+// timestamp.
+#define BOOTINFO_A20        (BOOTINFO_E820MAP + BOOTINFO_E820MAX * E820_ENTSIZE)
+#define BOOTINFO_A20TSC     (BOOTINFO + 16)
+
+// How A20 got enabled (bi_a20)
+#define A20_PRESET          1       // it already was
+#define A20_BIOS            2       // INT 15h, AX=2401h
+#define A20_FAST            3       // port 0x92 fast A20 gate
+#define A20_KBC             4       // 8042 keyboard controller (unchecked)
+
+// What a boot-phase timestamp marks (struct Bootstamp's bs_what)
+#define BS_RESET        0   // boot sector entered (boot.S)
+#define BS_STAGE2       1   // stage 2 loaded and entered
+#define BS_SEGMENT      2   // a run of segments read; bs_arg is its address
+#define BS_LZ4          3   // compressed segments expanded
+#define BS_BSS          4   // segment tails zero-filled
+#define BS_KERNEL       5   // about to jump to the kernel entry point
+#define BS_A20          6   // A20 enabled (boot.S); bs_arg is the A20_* way
+
+#ifndef __ASSEMBLER__
+
+#include <inc/types.h>
+
+struct Bootstamp {
+    uint64_t bs_tsc;            // read_tsc() when the phase ended
+    uint32_t bs_what;           // BS_*
+    uint32_t bs_arg;
+};
+
+struct E820ent {
+    uint64_t e_addr;
+    uint64_t e_len;
+    uint32_t e_type;            // E820_*
+} __attribute__((packed));
+
+struct Bootinfo {
+    // must stay first; see BOOTINFO_RESETTSC
+    struct Bootstamp bi_stamps[BOOTINFO_NSTAMPS];
+
+    // filled in by boot.S; see BOOTINFO_E820SIZE, BOOTINFO_E820MAP and
+    // BOOTINFO_A20
+    uint32_t bi_e820size;       // bytes of bi_e820 in use, 0 if unsupported
+    struct E820ent bi_e820[BOOTINFO_E820MAX];
+    uint8_t bi_a20;             // A20_*
+
+    // everything from here on is cleared by stage 2
+    uint32_t bi_nstamps;
+
+    uint32_t bi_magic;          // BOOTINFO_MAGIC if the loader filled this in
+
+    // LZ4-compressed kernel images (KERN_COMPRESS=lz4); all zero if the
+    // kernel was stored raw
+    uint32_t bi_lz4_csize;      // compressed bytes read off the disk
+    uint32_t bi_lz4_usize;      // bytes they expanded to
+    uint64_t bi_lz4_cycles;     // TSC cycles spent expanding them
+};
+
+#endif  // !__ASSEMBLER__
+
+#endif  // !_POTATOS_INC_BOOTINFO_H_
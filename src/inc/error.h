@@ -0,0 +1,20 @@
+#ifndef _POTATOS_INC_ERROR_H_
+#define _POTATOS_INC_ERROR_H_
+
+enum {
+    // Kernel error codes, returned negated (-E_NO_MEM)
+    E_UNSPECIFIED = 1,  // Unspecified or unknown problem
+    E_BAD_ENV,          // Environment doesn't exist or otherwise
+                        // cannot be used in requested action
+    E_INVAL,            // Invalid parameter
+    E_NO_MEM,           // Request failed due to memory shortage
+    E_NO_FREE_ENV,      // Attempt to create a new environment beyond
+                        // the maximum allowed
+    E_FAULT,            // Memory fault
+    E_IO,               // Disk I/O error
+    E_NO_DISK,          // No free space on disk
+
+    MAXERROR
+};
+
+#endif  // !_POTATOS_INC_ERROR_H_
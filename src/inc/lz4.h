@@ -0,0 +1,40 @@
+#ifndef _POTATOS_INC_LZ4_H_
+#define _POTATOS_INC_LZ4_H_
+
+#include <inc/types.h>
+
+/**
+ * The LZ4 block format (no frame header, no checksums).  src/boot/mklz4.py
+ * and lz4_compress() produce blocks in it, and lz4_decompress() expands
+ * them.  The decoder is in lib/lz4.c, which the boot loader links too;
+ * the encoder is in lib/lz4compress.c, which only the kernel needs.
+ */
+
+// lz4_compress()'s hash table: LZ4_HASHSIZE entries
+#define LZ4_HASHLOG     12
+#define LZ4_HASHSIZE    (1 << LZ4_HASHLOG)
+// and the largest input it takes
+#define LZ4_MAXINPUT    0xffff
+
+/**
+ * Expand an LZ4 block.
+ * @param  dst      where to write the expanded data
+ * @param  dstsize  room available at dst
+ * @param  src      the compressed block
+ * @param  srcsize  size of the compressed block
+ * @return          number of bytes written to dst, or -1 if the block is
+ *                  malformed or would not fit in dstsize bytes
+ */
+int lz4_decompress(void *dst, size_t dstsize, const void *src, size_t srcsize);
+
+/**
+ * Compress src into one LZ4 block with a greedy hash matcher, giving up
+ * as soon as the block would not fit in dstsize bytes.
+ * @param  table    LZ4_HASHSIZE entries of scratch space
+ * @return          size of the block, or -1 if it would not fit in
+ *                  dstsize bytes or srcsize is over LZ4_MAXINPUT
+ */
+int lz4_compress(void *dst, size_t dstsize, const void *src, size_t srcsize,
+                 uint16_t *table);
+
+#endif  // !_POTATOS_INC_LZ4_H_
@@ -4,6 +4,7 @@
 #ifndef __ASSEMBLER__
 #include <inc/types.h>
 #include <inc/mmu.h>
+#include <inc/queue.h>
 #endif
 
 /**
@@ -36,9 +37,13 @@
  *                     |  Cur. Page Table (Kern. RW)  | RW/--  PTSIZE
  *    VPT,KSTACKTOP--> +------------------------------+ 0xefc00000      --+
  *                     |         Kernel Stack         | RW/--  KSTKSIZE   |
- *                     | - - - - - - - - - - - - - - -|                 PTSIZE
+ *                     | - - - - - - - - - - - - - - -|                   |
  *                     |      Invalid Memory (*)      | --/--             |
- *    ULIM     ------> +------------------------------+ 0xef800000      --+
+ *    MMIOLIM ------>  | - - - - - - - - - - - - - - -|                 PTSIZE
+ *                     |    Memory-mapped Devices     | RW/--  3MB        |
+ *    MMIOBASE ----->  | - - - - - - - - - - - - - - -|                   |
+ *                     |       High Memory Kmaps      | RW/--  KMAPSIZE   |
+ *    ULIM,KMAPBASE -> +------------------------------+ 0xef800000      --+
  *                     |  Cur. Page Table (User R-)   | R-/R-  PTSIZE
  *    UVPT      ---->  +------------------------------+ 0xef400000
  *                     |          RO PAGES            | R-/R-  PTSIZE
@@ -101,6 +106,14 @@
 #define KSTACKTOP   VPT
 #define KSTKSIZE    (8 * PGSIZE) // size of a kernel stack
 #define ULIM        (KSTACKTOP - PTSIZE)
+// Temporary kernel mappings of pages beyond the direct map at KERNBASE;
+// see kernel/kmap.h
+#define KMAPBASE    ULIM
+#define KMAPSIZE    (128 * PGSIZE)
+// Device memory and framebuffers, mapped with their memory types by
+// mmio_map_region(); see kernel/pat.h
+#define MMIOBASE    (KMAPBASE + KMAPSIZE)
+#define MMIOLIM     (MMIOBASE + 3 * 1024 * 1024)
 
 
 /**
@@ -186,9 +199,30 @@ struct Page {
     // Pages allocated at boot time using pmap.c's
     // boot_alloc do not have valid reference count fields.
 
-    uint16_t pp_ref;
+    uint32_t pp_ref;
+
+    // The buddy allocator hands out blocks of 2^order pages.  The first
+    // Page of a free block has PP_FREE set and its order in pp_order;
+    // the rest of the block is not on any list.
+    uint8_t pp_order;
+    uint8_t pp_flags;
+
+    // With PP_SLAB set, the slab (kernel/slab.c) this page is part of.
+    struct Slab *pp_slab;
+
+    // The mappings that hold references on this page (kernel/rmap.h)
+    struct Rmap *pp_rmap;
 };
 
+// Page flags (pp_flags)
+#define PP_FREE     0x01    // first page of a free block
+#define PP_SLAB     0x02    // part of a slab; see pp_slab
+#define PP_ZEROFILL 0x04    // still as vm_fault() zeroed it, unless a
+                            // mapping has PTE_D; see kernel/swap.h
+
+// pp_ref never goes past this; see page_incref()
+#define PP_REF_MAX  0x7fffffff
+
 
 #endif  // !__ASSEMBLER__
 
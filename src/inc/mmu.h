@@ -69,9 +69,25 @@
 #define PTE_PS      0x080   // Page Size
 #define PTE_G       0x100   // Global
 
+// In a 4KB page's PTE, the bit PTE_PS is in a PDE picks a PAT entry
+// along with PTE_PCD and PTE_PWT; see kernel/pat.h.
+#define PTE_PAT     0x080
+
 // The PTE_AVAIL bits aren't used by the kernel or interpreted by the
 // hardware, so user processes are allowed to set them arbitrarily.
-#define PTE_AVAIL   0xe00   // available for software use
+#define PTE_AVAIL   0x600   // available for software use
+
+// The third software bit belongs to the kernel: a copy-on-write page,
+// mapped read-only until a write fault gives the writer its own copy.
+#define PTE_COW     0x800
+
+// A PTE without PTE_P is either zero or, with PTE_SWAP, the swap entry
+// of a page that was swapped out, with its swap slot where the page
+// address would be; see kernel/swap.h.  PTE_ZSWAP says the slot is in
+// the compressed pool rather than on disk; see kernel/zswap.h.  The
+// hardware ignores every bit of a PTE without PTE_P.
+#define PTE_SWAP    0x002
+#define PTE_ZSWAP   0x004
 
 // Only flags in PTE_ALLOWED may be used in system calls.
 #define PTE_ALLOWED (PTE_AVAIL | PTE_P | PTE_W | PTE_U)
@@ -93,6 +109,7 @@
 #define CR0_PG      0x80000000  // Paging
 
 #define CR4_PCE     0x00000100  // Performance counter enable
+#define CR4_PGE     0x00000080  // Page Global Enable
 #define CR4_MCE     0x00000040  // Machine Check Enable
 #define CR4_PSE     0x00000010  // Page Size Extensions
 #define CR4_DE      0x00000008  // Debugging Extensions
@@ -100,6 +117,15 @@
 #define CR4_PVI     0x00000002  // Protected-Mode Virtual Interrupts
 #define CR4_VME     0x00000001  // V86 Mode Extensions
 
+// Paging features in cpuid(1)'s %edx
+#define CPUID_PSE   0x00000008  // Page Size Extensions (PTE_PS)
+#define CPUID_PGE   0x00002000  // Page Global Enable (PTE_G)
+#define CPUID_PAT   0x00010000  // Page Attribute Table
+#define CPUID_SSE2  0x04000000  // SSE2, for movnti
+
+// Model-specific registers
+#define MSR_PAT     0x277       // Page Attribute Table
+
 // Eflags register
 #define FL_CF        0x00000001  // Carry Flag
 #define FL_PF        0x00000004  // Parity Flag
@@ -0,0 +1,53 @@
+#ifndef _POTATOS_INC_MULTIBOOT_H_
+#define _POTATOS_INC_MULTIBOOT_H_
+
+/**
+ * The parts of the Multiboot specification (version 0.6.96) the kernel
+ * uses: the header entry.S advertises to loaders like GRUB, and the
+ * information structure they pass back.
+ */
+
+#define MULTIBOOT_HEADER_MAGIC      0x1BADB002
+// in %eax at kernel entry when a Multiboot loader booted us
+#define MULTIBOOT_BOOTLOADER_MAGIC  0x2BADB002
+
+// Multiboot header flags
+#define MULTIBOOT_PAGE_ALIGN    0x00000001  // page-align boot modules
+#define MULTIBOOT_MEMORY_INFO   0x00000002  // pass mem_* and mmap_*
+
+// Multiboot info flags (mi_flags): which fields are valid
+#define MULTIBOOT_INFO_MEMORY   0x00000001  // mi_mem_lower, mi_mem_upper
+#define MULTIBOOT_INFO_MMAP     0x00000040  // mi_mmap_length, mi_mmap_addr
+
+#ifndef __ASSEMBLER__
+
+#include <inc/types.h>
+
+struct Multiboot_info {
+    uint32_t mi_flags;          // MULTIBOOT_INFO_*
+    uint32_t mi_mem_lower;      // KB of memory from 0
+    uint32_t mi_mem_upper;      // KB of memory from 1MB
+    uint32_t mi_boot_device;
+    uint32_t mi_cmdline;
+    uint32_t mi_mods_count;
+    uint32_t mi_mods_addr;
+    uint32_t mi_syms[4];
+    uint32_t mi_mmap_length;    // bytes of memory map
+    uint32_t mi_mmap_addr;      // physical address of memory map
+};
+
+/**
+ * Memory map entry.  mm_size is the size of the rest of the entry, so
+ * the next one starts mm_size + 4 bytes after this one.  Otherwise the
+ * same as an E820 entry (struct E820ent in inc/bootinfo.h).
+ */
+struct Multiboot_mmap {
+    uint32_t mm_size;
+    uint64_t mm_addr;
+    uint64_t mm_len;
+    uint32_t mm_type;           // E820_*
+} __attribute__((packed));
+
+#endif  // !__ASSEMBLER__
+
+#endif  // !_POTATOS_INC_MULTIBOOT_H_
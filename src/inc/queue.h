@@ -0,0 +1,76 @@
+#ifndef _POTATOS_INC_QUEUE_H_
+#define _POTATOS_INC_QUEUE_H_
+
+/**
+ * Doubly-linked lists, after BSD's <sys/queue.h>.
+ *
+ * A list is headed by a single forward pointer (or an array of forward
+ * pointers for a hash table header).  The elements are doubly linked so
+ * that an arbitrary element can be removed without a need to traverse
+ * the list.  New elements can be added to the list before or after an
+ * existing element or at the head of the list.  A list may only be
+ * traversed in the forward direction.
+ *
+ * The le_prev field of an element points at the le_next field of the
+ * previous element (or at the list head's lh_first), which is what
+ * makes LIST_REMOVE O(1) without a separate back pointer to the head.
+ */
+
+#define LIST_HEAD(name, type)                                           \
+struct name {                                                           \
+    struct type *lh_first;  /* first element */                         \
+}
+
+#define LIST_HEAD_INITIALIZER(head)                                     \
+    { NULL }
+
+#define LIST_ENTRY(type)                                                \
+struct {                                                                \
+    struct type *le_next;   /* next element */                          \
+    struct type **le_prev;  /* address of previous next element */      \
+}
+
+#define LIST_EMPTY(head)        ((head)->lh_first == NULL)
+
+#define LIST_FIRST(head)        ((head)->lh_first)
+
+#define LIST_NEXT(elm, field)   ((elm)->field.le_next)
+
+#define LIST_FOREACH(var, head, field)                                  \
+    for ((var) = LIST_FIRST((head));                                    \
+         (var);                                                         \
+         (var) = LIST_NEXT((var), field))
+
+#define LIST_INIT(head) do {                                            \
+    LIST_FIRST((head)) = NULL;                                          \
+} while (0)
+
+#define LIST_INSERT_AFTER(listelm, elm, field) do {                     \
+    if ((LIST_NEXT((elm), field) = LIST_NEXT((listelm), field)) != NULL)\
+        LIST_NEXT((listelm), field)->field.le_prev =                    \
+            &LIST_NEXT((elm), field);                                   \
+    LIST_NEXT((listelm), field) = (elm);                                \
+    (elm)->field.le_prev = &LIST_NEXT((listelm), field);                \
+} while (0)
+
+#define LIST_INSERT_BEFORE(listelm, elm, field) do {                    \
+    (elm)->field.le_prev = (listelm)->field.le_prev;                    \
+    LIST_NEXT((elm), field) = (listelm);                                \
+    *(listelm)->field.le_prev = (elm);                                  \
+    (listelm)->field.le_prev = &LIST_NEXT((elm), field);                \
+} while (0)
+
+#define LIST_INSERT_HEAD(head, elm, field) do {                         \
+    if ((LIST_NEXT((elm), field) = LIST_FIRST((head))) != NULL)         \
+        LIST_FIRST((head))->field.le_prev = &LIST_NEXT((elm), field);   \
+    LIST_FIRST((head)) = (elm);                                         \
+    (elm)->field.le_prev = &LIST_FIRST((head));                         \
+} while (0)
+
+#define LIST_REMOVE(elm, field) do {                                    \
+    if (LIST_NEXT((elm), field) != NULL)                                \
+        LIST_NEXT((elm), field)->field.le_prev = (elm)->field.le_prev;  \
+    *(elm)->field.le_prev = LIST_NEXT((elm), field);                    \
+} while (0)
+
+#endif  // !_POTATOS_INC_QUEUE_H_
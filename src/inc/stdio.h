@@ -0,0 +1,28 @@
+#ifndef _POTATOS_INC_STDIO_H_
+#define _POTATOS_INC_STDIO_H_
+
+#include <inc/stdarg.h>
+
+#ifndef NULL
+#define NULL ((void*) 0)
+#endif
+
+// kernel/console.c
+void cputchar(int c);
+int getchar(void);
+int iscons(int fd);
+
+// lib/printfmt.c
+void printfmt(void (*putch)(int, void*), void *putdat, const char *fmt, ...);
+void vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list);
+int snprintf(char *str, int size, const char *fmt, ...);
+int vsnprintf(char *str, int size, const char *fmt, va_list);
+
+// kernel/printf.c
+int cprintf(const char *fmt, ...);
+int vcprintf(const char *fmt, va_list);
+
+// lib/readline.c
+char *readline(const char *prompt);
+
+#endif  // !_POTATOS_INC_STDIO_H_
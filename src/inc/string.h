@@ -6,6 +6,7 @@
 int strlen(const char *s);
 int strnlen(const char *s, size_t size);
 char *strcpy(char *dst, const char *src);
+char *strcat(char *dst, const char *src);
 char *strncpy(char *dst, const char *src, size_t size);
 size_t strlcpy(char *dst, const char *src, size_t size);
 int strcmp(const char *s1, const char *s2);
@@ -60,8 +60,8 @@ typedef int32_t off_t;
 
 // Round up to the nearest multiple of n
 #define ROUNDUP(a, n) ({ \
-    uint32_t _a = (uint32_t) (a); \
-    (typeof(a)) (_a - _a % (n)); \
+    uint32_t _n = (uint32_t) (n); \
+    (typeof(a)) (ROUNDDOWN((uint32_t) (a) + _n - 1, _n)); \
 })
 
 // Return the offset of 'member' relative to the beginning of a struct type
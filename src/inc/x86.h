@@ -16,6 +16,9 @@ static __inline void outw(int port, uint16_t data) __attribute__((always_inline)
 static __inline void outsw(int port, const void *addr, int cnt) __attribute__((always_inline));
 static __inline void outsl(int port, const void *addr, int cnt) __attribute__((always_inline));
 static __inline void outl(int port, uint32_t data) __attribute__((always_inline));
+static __inline void stosb(void *addr, int data, int cnt) __attribute__((always_inline));
+static __inline void stosl(void *addr, int data, int cnt) __attribute__((always_inline));
+static __inline void movsl(void *dst, const void *src, int cnt) __attribute__((always_inline));
 static __inline void invlpg(void *addr) __attribute__((always_inline));
 static __inline void lidt(void *p) __attribute__((always_inline));
 static __inline void lldt(uint16_t sel) __attribute__((always_inline));
@@ -28,12 +31,17 @@ static __inline uint32_t rcr3(void) __attribute__((always_inline));
 static __inline void lcr4(uint32_t val) __attribute__((always_inline));
 static __inline uint32_t rcr4(void) __attribute__((always_inline));
 static __inline void tlbflush(void) __attribute__((always_inline));
+static __inline void tlbflush_all(void) __attribute__((always_inline));
 static __inline uint32_t read_eflags(void) __attribute__((always_inline));
 static __inline void write_eflags(uint32_t eflags) __attribute__((always_inline));
 static __inline uint32_t read_ebp(void) __attribute__((always_inline));
 static __inline uint32_t read_esp(void) __attribute__((always_inline));
 static __inline void cpuid(uint32_t info, uint32_t *eaxp, uint32_t *ebxp, uint32_t *ecxp, uint32_t *edxp);
 static __inline uint64_t read_tsc(void) __attribute__((always_inline));
+static __inline uint32_t xchg(volatile uint32_t *addr, uint32_t newval) __attribute__((always_inline));
+static __inline uint64_t rdmsr(uint32_t msr) __attribute__((always_inline));
+static __inline void wrmsr(uint32_t msr, uint64_t val) __attribute__((always_inline));
+static __inline void wbinvd(void) __attribute__((always_inline));
 
 static __inline void breakpoint(void) {
     __asm __volatile("int3");
@@ -111,6 +119,27 @@ static __inline void outl(int port, uint32_t data) {
     __asm __volatile("outl %0,%w1" : : "a" (data), "d" (port));
 }
 
+static __inline void stosb(void *addr, int data, int cnt) {
+    __asm __volatile("cld\n\trep\n\tstosb" :
+             "=D" (addr), "=c" (cnt) :
+             "0" (addr), "1" (cnt), "a" (data) :
+             "memory", "cc");
+}
+
+static __inline void stosl(void *addr, int data, int cnt) {
+    __asm __volatile("cld\n\trep\n\tstosl" :
+             "=D" (addr), "=c" (cnt) :
+             "0" (addr), "1" (cnt), "a" (data) :
+             "memory", "cc");
+}
+
+static __inline void movsl(void *dst, const void *src, int cnt) {
+    __asm __volatile("cld\n\trep\n\tmovsl" :
+             "=D" (dst), "=S" (src), "=c" (cnt) :
+             "0" (dst), "1" (src), "2" (cnt) :
+             "memory", "cc");
+}
+
 static __inline void invlpg(void *addr) {
     __asm __volatile("invlpg (%0)" : : "r" (addr) : "memory");
 }
@@ -163,12 +192,26 @@ static __inline uint32_t rcr4(void) {
     return cr4;
 }
 
+// Flush the TLB, except for global (PTE_G) entries when CR4_PGE is on.
 static __inline void tlbflush(void) {
     uint32_t cr3;
     __asm __volatile("movl %%cr3,%0" : "=r" (cr3));
     __asm __volatile("movl %0,%%cr3" : : "r" (cr3));
 }
 
+// Flush the whole TLB, global entries included: turning CR4_PGE off and
+// back on does that.  Only needed when a global mapping changes.
+static __inline void tlbflush_all(void) {
+    uint32_t cr4;
+    __asm __volatile("movl %%cr4,%0" : "=r" (cr4));
+    if (cr4 & 0x80) {   // CR4_PGE
+        __asm __volatile("movl %0,%%cr4" : : "r" (cr4 & ~0x80));
+        __asm __volatile("movl %0,%%cr4" : : "r" (cr4));
+    } else {
+        tlbflush();
+    }
+}
+
 static __inline uint32_t read_eflags(void) {
     uint32_t eflags;
     __asm __volatile("pushfl; popl %0" : "=r" (eflags));
@@ -216,4 +259,29 @@ static __inline uint64_t read_tsc(void) {
     return tsc;
 }
 
+static __inline uint32_t xchg(volatile uint32_t *addr, uint32_t newval) {
+    uint32_t result;
+
+    // The + in "+m" denotes a read-modify-write operand.
+    __asm __volatile("lock; xchgl %0, %1" :
+             "+m" (*addr), "=a" (result) :
+             "1" (newval) :
+             "cc");
+    return result;
+}
+
+static __inline uint64_t rdmsr(uint32_t msr) {
+    uint64_t val;
+    __asm __volatile("rdmsr" : "=A" (val) : "c" (msr));
+    return val;
+}
+
+static __inline void wrmsr(uint32_t msr, uint64_t val) {
+    __asm __volatile("wrmsr" : : "c" (msr), "A" (val));
+}
+
+static __inline void wbinvd(void) {
+    __asm __volatile("wbinvd" : : : "memory");
+}
+
 #endif  // !_POTATOS_INC_X86_H_
@@ -0,0 +1,102 @@
+#include <inc/x86.h>
+#include <inc/memlayout.h>
+#include <inc/bootinfo.h>
+#include <inc/stdio.h>
+
+#include <kernel/boottime.h>
+
+// room for everything the loader can record plus the kernel's own marks
+#define NSTAMPS     (BOOTINFO_NSTAMPS + 16)
+
+static struct {
+    uint64_t tsc;
+    const char *what;
+    uint32_t arg;
+} stamps[NSTAMPS];
+static int nstamps;
+
+// the loader's LZ4 statistics, if the kernel was stored compressed
+static uint32_t lz4_csize, lz4_usize;
+static uint64_t lz4_cycles;
+
+// names of the loader's phases, indexed by BS_*
+static const char *loader_phases[] = {
+    [BS_RESET]      = "reset",
+    [BS_STAGE2]     = "stage 2 loaded",
+    [BS_SEGMENT]    = "segments read",
+    [BS_LZ4]        = "kernel expanded",
+    [BS_BSS]        = "bss cleared",
+    [BS_KERNEL]     = "loader done",
+    [BS_A20]        = "A20 enabled",
+};
+
+// how boot.S enabled A20, indexed by A20_* (the BS_A20 stamp's bs_arg)
+static const char *a20_methods[] = {
+    [A20_PRESET]    = "A20 already on",
+    [A20_BIOS]      = "A20 by BIOS",
+    [A20_FAST]      = "A20 by port 0x92",
+    [A20_KBC]       = "A20 by 8042",
+};
+
+void boottime_init(void) {
+    struct Bootinfo *bi = (struct Bootinfo*) (KERNBASE + BOOTINFO);
+    struct Bootstamp *bs;
+    uint32_t i;
+
+    // booted by something other than our loader (GRUB, say): the
+    // timeline starts at the kernel
+    if (bi->bi_magic == BOOTINFO_MAGIC) {
+        for (i = 0; i < bi->bi_nstamps && i < BOOTINFO_NSTAMPS; ++i) {
+            bs = &bi->bi_stamps[i];
+            stamps[nstamps].tsc = bs->bs_tsc;
+            stamps[nstamps].arg = bs->bs_arg;
+            if (bs->bs_what == BS_A20 && bs->bs_arg > 0
+                && bs->bs_arg < sizeof(a20_methods) / sizeof(a20_methods[0])) {
+                stamps[nstamps].what = a20_methods[bs->bs_arg];
+                stamps[nstamps].arg = 0;
+            } else if (bs->bs_what < sizeof(loader_phases) / sizeof(loader_phases[0])) {
+                stamps[nstamps].what = loader_phases[bs->bs_what];
+            } else {
+                stamps[nstamps].what = "loader";
+            }
+            ++nstamps;
+        }
+
+        lz4_csize = bi->bi_lz4_csize;
+        lz4_usize = bi->bi_lz4_usize;
+        lz4_cycles = bi->bi_lz4_cycles;
+    }
+
+    boottime_mark("kernel entered");
+}
+
+void boottime_mark(const char *what) {
+    if (nstamps == NSTAMPS) {
+        return;
+    }
+    stamps[nstamps].tsc = read_tsc();
+    stamps[nstamps].what = what;
+    stamps[nstamps].arg = 0;
+    ++nstamps;
+}
+
+void boottime_print(void) {
+    // Each line is the phase that ended at that stamp, the cycles it
+    // took, and the cycles since the first stamp.
+    cprintf("boot timeline (TSC cycles):\n");
+    for (int i = 0; i < nstamps; ++i) {
+        cprintf("  %-18s %12llu %14llu",
+                stamps[i].what,
+                i > 0 ? stamps[i].tsc - stamps[i - 1].tsc : 0ULL,
+                stamps[i].tsc - stamps[0].tsc);
+        if (stamps[i].arg) {
+            cprintf("  [0x%08x]", stamps[i].arg);
+        }
+        cprintf("\n");
+    }
+
+    if (lz4_csize) {
+        cprintf("  kernel image: %u bytes expanded to %u in %llu cycles\n",
+                lz4_csize, lz4_usize, lz4_cycles);
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef _POTATOS_KERNEL_BOOTTIME_H_
+#define _POTATOS_KERNEL_BOOTTIME_H_
+#ifndef POS_KERNEL
+#error "This is a PotatOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+/**
+ * Boot-phase timeline.  Picks up the TSC timestamps the boot loader left
+ * in its Bootinfo block (see inc/bootinfo.h) and extends them with one
+ * per kernel init step, so boot time can be broken down per phase.
+ */
+
+/**
+ * Copy the loader's timestamps out of the Bootinfo page and mark the
+ * kernel's entry.  Must run before anything reuses low memory.
+ */
+void boottime_init(void);
+
+/**
+ * Mark the end of a boot phase.
+ * @param what  name of the phase that just finished; must be a string
+ *              constant, it is kept by reference
+ */
+void boottime_mark(const char *what);
+
+/**
+ * Print the per-phase cycle breakdown on the console.
+ */
+void boottime_print(void);
+
+#endif  // !_POTATOS_KERNEL_BOOTTIME_H_
@@ -1,8 +1,11 @@
 #include <inc/x86.h>
 #include <inc/memlayout.h>
 #include <inc/string.h>
+#include <inc/stdio.h>
 
 #include <kernel/console.h>
+#include <kernel/pagezero.h>
+#include <kernel/pat.h>
 
 
 // Stupid I/O delay routine necessitated by historical PC design flaws
@@ -36,6 +39,8 @@ static void delay(void) { inb(0x84); inb(0x84); inb(0x84); inb(0x84); }
 
 static bool serial_exists;
 
+static void cons_intr(int (*proc)(void));
+
 static int serial_proc_data(void) {
     if (!(inb(COM1 + COM_LSR) & COM_LSR_DATA)) {
         return -1;
@@ -76,7 +81,7 @@ static void serial_init(void) {
 
     // clear any pre-existing overrun indications and interrupts
     // serial port doesn't exist if COM_LSR returns 0xff
-    serial_exists = (inb(COM1 + COM_LSR) != 0xff)
+    serial_exists = (inb(COM1 + COM_LSR) != 0xff);
     (void) inb(COM1 + COM_IIR);
     (void) inb(COM1 + COM_RX);
 }
@@ -96,21 +101,31 @@ static void lpt_putc(int c) {
 
 /**
  * Text-mode CGA/VGA display output
+ *
+ * Until console_remap() runs, the text buffer is reached through the
+ * direct map.  After that it is mapped write-combining, which makes
+ * writing it fast and reading it very slow, so everything on screen is
+ * kept in crt_shadow too: scrolling moves the shadow, and then writes
+ * the screen out from it in one sequential sweep.
  */
 static unsigned addr_6845;
-static uint16_t *crt_buf;
+static physaddr_t crt_phys;
+static volatile uint16_t *crt_buf;
+static uint16_t crt_shadow[CRT_SIZE];
 static uint16_t crt_pos;
 
 static void cga_init(void) {
-    volatile uint16_t cp = (uint16_t*) (KERNBASE + CGA_BUFF);
+    volatile uint16_t *cp = (uint16_t*) (KERNBASE + CGA_BUFF);
     uint16_t was = *cp;
     *cp = (uint16_t) 0xa55a;
     if (*cp != 0xa55a) {
         cp = (uint16_t*) (KERNBASE + MONO_BUFF);
-        addr_6845 = MONO_BUFF;
+        addr_6845 = MONO_BASE;
+        crt_phys = MONO_BUFF;
     } else {
         *cp = was;
         addr_6845 = CGA_BASE;
+        crt_phys = CGA_BUFF;
     }
 
     // extract cursor location
@@ -119,14 +134,95 @@ static void cga_init(void) {
     outb(addr_6845, 15);
     pos |= inb(addr_6845 + 1);
 
-    crt_buf = (uint16_t*) cp;
+    crt_buf = cp;
     crt_pos = pos;
+    // the last time the screen is read
+    memmove(crt_shadow, (void *) crt_buf, sizeof(crt_shadow));
+}
+
+// Copy the shadow's [start, end) to the screen.
+static void cga_flush(int start, int end) {
+    int i;
+
+    for (i = start; i < end; ++i) {
+        crt_buf[i] = crt_shadow[i];
+    }
+}
+
+static void cga_putc(int c) {
+    int i;
+
+    // if no attribute given, then use black on white
+    if (!(c & ~0xff)) {
+        c |= 0x0700;
+    }
+
+    switch (c & 0xff) {
+    case '\b':
+        if (crt_pos > 0) {
+            crt_pos--;
+            crt_buf[crt_pos] = crt_shadow[crt_pos] = (c & ~0xff) | ' ';
+        }
+        break;
+    case '\n':
+        crt_pos += CRT_COLS;
+        /* fallthru */
+    case '\r':
+        crt_pos -= (crt_pos % CRT_COLS);
+        break;
+    case '\t':
+        for (i = 0; i < 4; ++i) {
+            cga_putc(' ');
+        }
+        break;
+    default:
+        crt_buf[crt_pos] = crt_shadow[crt_pos] = c;
+        crt_pos++;
+        break;
+    }
+
+    if (crt_pos >= CRT_SIZE) {
+        memmove(crt_shadow, crt_shadow + CRT_COLS,
+                (CRT_SIZE - CRT_COLS) * sizeof(uint16_t));
+        for (i = CRT_SIZE - CRT_COLS; i < CRT_SIZE; i++) {
+            crt_shadow[i] = 0x0700 | ' ';
+        }
+        cga_flush(0, CRT_SIZE);
+        crt_pos -= CRT_COLS;
+    }
+
+    // move that little blinky thing
+    outb(addr_6845, 14);
+    outb(addr_6845 + 1, crt_pos >> 8);
+    outb(addr_6845, 15);
+    outb(addr_6845 + 1, crt_pos);
+}
+
+void console_remap(void) {
+    crt_buf = mmio_map_region(crt_phys, CRT_SIZE * sizeof(uint16_t), MT_WC);
+    cga_flush(0, CRT_SIZE);
 }
 
 /**
  * Keyboard input code
  */
 
+#define KBSTATP     0x64    // kbd controller status port (I)
+#define KBS_DIB     0x01    // kbd data in buffer
+#define KBDATAP     0x60    // kbd data port (I)
+
+// Special keycodes
+#define KEY_HOME    0xe0
+#define KEY_END     0xe1
+#define KEY_UP      0xe2
+#define KEY_DN      0xe3
+#define KEY_LF      0xe4
+#define KEY_RT      0xe5
+#define KEY_PGUP    0xe6
+#define KEY_PGDN    0xe7
+#define KEY_INS     0xe8
+#define KEY_DEL     0xe9
+
 #define NO      0
 
 #define SHIFT   (1<<0)
@@ -249,7 +345,7 @@ static int kbd_proc_data(void) {
     shift |= shiftcode[data];
     shift ^= togglecode[data];
 
-    c = charcode[shift & (CTL | SHIFT)][data];
+    int c = charcode[shift & (CTL | SHIFT)][data];
     if (shift & CAPSLOCK) {
         if ('a' <= c && c <= 'z') {
             c += 'A' - 'a';
@@ -268,7 +364,7 @@ static int kbd_proc_data(void) {
 }
 
 void kbd_intr(void) {
-    console_intr(kbd_proc_data);
+    cons_intr(kbd_proc_data);
 }
 
 static void kbd_init(void) {
@@ -356,8 +452,9 @@ void cputchar(int c) {
 
 int getchar(void) {
     int c;
-    while ((c = cons_getc()) == 0) {
-        // do nothing
+    // No scheduler yet, so waiting for input is the idle loop.
+    while ((c = cons_getc()) == -1) {
+        pagezero_idle();
     }
     return c;
 }
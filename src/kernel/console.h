@@ -1,6 +1,6 @@
 #ifndef _POTATOS_KERNEL_CONSOLE_H_
 #define _POTATOS_KERNEL_CONSOLE_H_
-#ifndef POTATOS_KERNEL
+#ifndef POS_KERNEL
 #error "NOOOOO!"
 #endif
 
@@ -21,6 +21,12 @@
  */
 void console_init(void);
 
+/**
+ * Move the text buffer from the direct map, where it is write-back, to
+ * a write-combining mapping.  Needs mem_init().
+ */
+void console_remap(void);
+
 /**
  * [console_getc description]
  * @return  [description]
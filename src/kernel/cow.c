@@ -0,0 +1,210 @@
+#include <inc/x86.h>
+#include <inc/mmu.h>
+#include <inc/error.h>
+#include <inc/string.h>
+#include <inc/stdio.h>
+#include <inc/assert.h>
+
+#include <kernel/cow.h>
+#include <kernel/pmap.h>
+#include <kernel/ptwalk.h>
+#include <kernel/tlb.h>
+#include <kernel/kmap.h>
+#include <kernel/swap.h>
+
+struct Cow_stats cow_stats;
+
+static void check_cow(void);
+
+// What a PTE's flags say about the mapping, as opposed to its history.
+#define PTE_MAPFLAGS    (PTE_U | PTE_W | PTE_PWT | PTE_PCD | PTE_AVAIL | \
+                         PTE_COW)
+
+void cow_init(void) {
+    check_cow();
+}
+
+// Share one of the parent's pages with the child, write-protecting it
+// in both if it is writable.
+static int copy_one(uintptr_t va, pte_t *pte, void *arg) {
+    pde_t *dst = arg;
+    pte_t *copy;
+    int perm, r;
+
+    // a swapped-out page is shared through its slot instead; each side
+    // reads its own copy back
+    if (pte_swapped(*pte)) {
+        if (!(copy = pgdir_walk(dst, (void *) va, 1))) {
+            return -E_NO_MEM;
+        }
+        if ((r = swap_dup(*pte)) < 0) {
+            return r;
+        }
+        *copy = *pte;
+        return 0;
+    }
+
+    if (*pte & (PTE_W | PTE_COW)) {
+        *pte = (*pte & ~PTE_W) | PTE_COW;
+    }
+    perm = *pte & PTE_MAPFLAGS;
+    if (*pte & PTE_PS) {
+        r = page_insert_huge(dst, pa2page(PTE_ADDR(*pte)), (void *) va, perm);
+    } else {
+        r = page_insert(dst, pa2page(PTE_ADDR(*pte)), (void *) va, perm);
+    }
+    if (r == 0) {
+        ++cow_stats.cs_shared;
+    }
+    return r;
+}
+
+int cow_copy(pde_t *dst, pde_t *src) {
+    int r;
+
+    r = pt_walk(src, 0, UTOP, copy_one, dst);
+
+    // One flush for all the write-protected pages, rather than an
+    // invlpg each.
+    if (rcr3() == PADDR(src)) {
+        tlbflush();
+    }
+    return r;
+}
+
+// cow_fault() for a 4MB page
+static int cow_fault_huge(pde_t *pgdir, pde_t *pde, void *va) {
+    struct Page *pp = pa2page(PTE_ADDR(*pde)), *copy;
+    int i, r;
+
+    va = ROUNDDOWN(va, PTSIZE);
+    if (pp->pp_ref == 1) {
+        *pde = (*pde & ~PTE_COW) | PTE_W;
+        tlb_invalidate(pgdir, va);
+        ++cow_stats.cs_reused;
+        return 0;
+    }
+
+    if (!(copy = pages_alloc(HUGE_ORDER, ALLOC_HIGH))) {
+        return -E_NO_MEM;
+    }
+    for (i = 0; i < (1 << HUGE_ORDER); ++i) {
+        page_copy(copy + i, pp + i);
+    }
+    // pp_ref > 1, so this cannot free pp
+    r = page_insert_huge(pgdir, copy, va,
+                         (*pde & PTE_MAPFLAGS & ~PTE_COW) | PTE_W);
+    if (r < 0) {
+        pages_free(copy, HUGE_ORDER);
+        return r;
+    }
+    ++cow_stats.cs_copied;
+    return 0;
+}
+
+int cow_fault(pde_t *pgdir, void *va) {
+    struct Page *pp, *copy;
+    pte_t *pte;
+    int r;
+
+    pte = pgdir_walk(pgdir, va, 0);
+    if (!pte || !(*pte & PTE_P) || !(*pte & PTE_COW)) {
+        return -E_FAULT;
+    }
+    if (*pte & PTE_PS) {
+        return cow_fault_huge(pgdir, pte, va);
+    }
+
+    va = ROUNDDOWN(va, PGSIZE);
+    pp = pa2page(PTE_ADDR(*pte));
+
+    // the last one holding it can have it
+    if (pp->pp_ref == 1) {
+        *pte = (*pte & ~PTE_COW) | PTE_W;
+        tlb_invalidate(pgdir, va);
+        ++cow_stats.cs_reused;
+        return 0;
+    }
+
+    if (!(copy = page_alloc(ALLOC_HIGH))) {
+        return -E_NO_MEM;
+    }
+    page_copy(copy, pp);
+    r = page_insert(pgdir, copy, va, (*pte & PTE_MAPFLAGS & ~PTE_COW) | PTE_W);
+    if (r < 0) {
+        page_free(copy);
+        return r;
+    }
+    ++cow_stats.cs_copied;
+    return 0;
+}
+
+/**
+ * Check that a copy shares pages until written, and that each side gets
+ * its own page -- or keeps the original -- on its first write.
+ */
+static void check_cow(void) {
+    struct Tlbbatch tb;
+    struct Page *pp, *ro;
+    pde_t *parent, *child;
+    pte_t *ppte, *cpte;
+    char *va = (char *) UTEXT, *kva;
+
+    assert((parent = pgdir_create()));
+    assert((child = pgdir_create()));
+    assert((pp = page_alloc(0)));
+    assert((ro = page_alloc(0)));
+    assert(page_insert(parent, pp, va, PTE_U | PTE_W) == 0);
+    assert(page_insert(parent, ro, va + PGSIZE, PTE_U) == 0);
+    strcpy(page2kva(pp), "parent");
+
+    assert(cow_copy(child, parent) == 0);
+    assert(page_lookup(parent, va, &ppte) == pp);
+    assert(page_lookup(child, va, &cpte) == pp);
+    assert(pp->pp_ref == 2 && ro->pp_ref == 2);
+    assert((*ppte & (PTE_W | PTE_COW)) == PTE_COW);
+    assert((*cpte & (PTE_W | PTE_COW)) == PTE_COW);
+    assert(!(*pgdir_walk(child, va + PGSIZE, 0) & (PTE_W | PTE_COW)));
+
+    // only COW pages take a write fault
+    assert(cow_fault(child, va + PGSIZE) == -E_FAULT);
+    assert(cow_fault(child, va + 2 * PGSIZE) == -E_FAULT);
+
+    // the child's write gets it a copy
+    assert(cow_fault(child, va + 12) == 0);
+    assert(page_lookup(child, va, &cpte) != pp);
+    assert((*cpte & (PTE_W | PTE_COW)) == PTE_W);
+    kva = kmap(page_lookup(child, va, NULL));
+    assert(strcmp(kva, "parent") == 0);
+    kunmap(kva);
+    assert(pp->pp_ref == 1);
+
+    // after which the parent's write just takes the page back
+    assert(cow_fault(parent, va) == 0);
+    assert(page_lookup(parent, va, &ppte) == pp);
+    assert((*ppte & (PTE_W | PTE_COW)) == PTE_W);
+
+    // Making the shared read-only page writable makes it copy-on-write,
+    // so the child's write cannot reach the parent's page ...
+    tlb_batch_init(&tb, child);
+    pt_protect(child, (uintptr_t) va + PGSIZE, (uintptr_t) va + 2 * PGSIZE,
+               PTE_U | PTE_W, &tb);
+    tlb_batch_flush(&tb);
+    assert(page_lookup(child, va + PGSIZE, &cpte) == ro);
+    assert((*cpte & (PTE_W | PTE_COW)) == PTE_COW);
+    assert(cow_fault(child, va + PGSIZE) == 0);
+    assert(page_lookup(child, va + PGSIZE, NULL) != ro && ro->pp_ref == 1);
+    assert(!(*pgdir_walk(parent, va + PGSIZE, 0) & (PTE_W | PTE_COW)));
+
+    // ... and once no one else holds it, it becomes writable outright
+    tlb_batch_init(&tb, parent);
+    pt_protect(parent, (uintptr_t) va + PGSIZE, (uintptr_t) va + 2 * PGSIZE,
+               PTE_U | PTE_W, &tb);
+    tlb_batch_flush(&tb);
+    assert(page_lookup(parent, va + PGSIZE, &ppte) == ro);
+    assert((*ppte & (PTE_W | PTE_COW)) == PTE_W);
+
+    pgdir_free(child);
+    pgdir_free(parent);
+    cprintf("check_cow() succeeded!\n");
+}
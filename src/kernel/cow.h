@@ -0,0 +1,48 @@
+#ifndef _POTATOS_KERNEL_COW_H_
+#define _POTATOS_KERNEL_COW_H_
+#ifndef POS_KERNEL
+#error "This is a PotatOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/memlayout.h>
+
+/**
+ * Copy-on-write address space duplication.  Instead of copying every
+ * page, cow_copy() maps each of the parent's pages into the child too,
+ * and write-protects the writable ones in both, marked PTE_COW.  The
+ * first write to such a page faults, and cow_fault() gives the writer
+ * its own copy -- or, if nobody else maps the page any more, just makes
+ * it writable again.  Read-only pages are simply shared.
+ */
+
+struct Cow_stats {
+    uint32_t cs_shared;         // pages mapped into a child by cow_copy()
+    uint32_t cs_copied;         // write faults that copied a page
+    uint32_t cs_reused;         // ... that found the page no longer shared
+};
+
+extern struct Cow_stats cow_stats;
+
+/**
+ * Check the copy-on-write machinery.  Needs the page allocator.
+ */
+void cow_init(void);
+
+/**
+ * Duplicate the user part (below UTOP) of src into dst, copy-on-write.
+ * @param dst  a page directory with nothing mapped below UTOP, from
+ *             pgdir_create()
+ * @return  0, or -E_NO_MEM.  On failure dst holds part of the copy and
+ *          should be freed with pgdir_free(); src is fine either way.
+ */
+int cow_copy(pde_t *dst, pde_t *src);
+
+/**
+ * Handle a write fault at va.
+ * @return  0 if it was a write to a PTE_COW page, which is now writable;
+ *          -E_FAULT if it was not; -E_NO_MEM
+ */
+int cow_fault(pde_t *pgdir, void *va);
+
+#endif  // !_POTATOS_KERNEL_COW_H_
@@ -0,0 +1,36 @@
+#ifndef _POTATOS_KERNEL_CPU_H_
+#define _POTATOS_KERNEL_CPU_H_
+#ifndef POS_KERNEL
+#error "This is a PotatOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+#include <kernel/pmap.h>
+
+// Maximum number of CPUs
+#define NCPU    8
+
+// Per-CPU state
+struct CpuInfo {
+    uint8_t cpu_id;                 // Local APIC ID; index into cpus[] below
+    struct Pagemag cpu_pagemag;     // this CPU's cache of free pages
+    int cpu_kmapdepth;              // kmap slots in use; see kmap.h
+};
+
+// Initialized in init.c
+extern struct CpuInfo cpus[NCPU];
+extern int ncpu;                    // Total number of CPUs in the system
+
+/**
+ * The current CPU's index in cpus[].  Only the boot CPU runs until the
+ * local APICs are brought up, so for now that is always 0.
+ */
+static inline int cpunum(void) {
+    return 0;
+}
+
+// The current CPU's struct CpuInfo
+#define thiscpu (&cpus[cpunum()])
+
+#endif  // !_POTATOS_KERNEL_CPU_H_
@@ -0,0 +1,119 @@
+#include <inc/x86.h>
+#include <inc/error.h>
+#include <inc/assert.h>
+
+#include <kernel/ide.h>
+
+#define IDE_DATA        0x1f0
+#define IDE_ERROR       0x1f1
+#define IDE_NSECT       0x1f2
+#define IDE_LBA0        0x1f3
+#define IDE_LBA1        0x1f4
+#define IDE_LBA2        0x1f5
+#define IDE_DRIVE       0x1f6   // 0xe0 | disk << 4 | LBA bits 24-27
+#define IDE_STATUS      0x1f7   // in
+#define IDE_CMD         0x1f7   // out
+
+#define IDE_BSY         0x80
+#define IDE_DRDY        0x40
+#define IDE_DF          0x20
+#define IDE_DRQ         0x08
+#define IDE_ERR         0x01
+
+#define IDE_CMD_READ        0x20
+#define IDE_CMD_WRITE       0x30
+#define IDE_CMD_FLUSH       0xe7
+#define IDE_CMD_IDENTIFY    0xec
+
+// Spins before deciding a disk that never gets ready is not there
+#define IDE_PROBE_SPINS     100000
+
+static int ide_wait_ready(bool check_error) {
+    int r;
+
+    while (((r = inb(IDE_STATUS)) & (IDE_BSY | IDE_DRDY)) != IDE_DRDY) {
+        /* do nothing */;
+    }
+    if (check_error && (r & (IDE_DF | IDE_ERR)) != 0) {
+        return -E_IO;
+    }
+    return 0;
+}
+
+static void ide_select(int diskno, uint32_t secno, size_t nsecs) {
+    assert(diskno == 0 || diskno == 1);
+    assert(nsecs <= 256 && secno < (1 << 28));
+
+    ide_wait_ready(0);
+    outb(IDE_NSECT, nsecs);     // 0 means 256
+    outb(IDE_LBA0, secno & 0xff);
+    outb(IDE_LBA1, (secno >> 8) & 0xff);
+    outb(IDE_LBA2, (secno >> 16) & 0xff);
+    outb(IDE_DRIVE, 0xe0 | (diskno << 4) | ((secno >> 24) & 0x0f));
+}
+
+uint32_t ide_probe(int diskno) {
+    uint16_t id[SECTSIZE / 2];
+    int i, r;
+
+    outb(IDE_DRIVE, 0xe0 | (diskno << 4));
+    for (i = 0; i < IDE_PROBE_SPINS; ++i) {
+        r = inb(IDE_STATUS);
+        if ((r & (IDE_BSY | IDE_DRDY)) == IDE_DRDY) {
+            break;
+        }
+    }
+    if (i == IDE_PROBE_SPINS || (r & (IDE_DF | IDE_ERR))) {
+        return 0;
+    }
+
+    outb(IDE_CMD, IDE_CMD_IDENTIFY);
+    for (i = 0; i < IDE_PROBE_SPINS; ++i) {
+        r = inb(IDE_STATUS);
+        if (!(r & IDE_BSY) && (r & (IDE_DRQ | IDE_ERR))) {
+            break;
+        }
+    }
+    if (i == IDE_PROBE_SPINS || (r & IDE_ERR)) {
+        return 0;
+    }
+    insl(IDE_DATA, id, SECTSIZE / 4);
+
+    // words 60-61: sectors addressable with 28-bit LBA
+    return id[60] | (uint32_t) id[61] << 16;
+}
+
+int ide_read(int diskno, uint32_t secno, void *dst, size_t nsecs) {
+    int r;
+
+    ide_select(diskno, secno, nsecs);
+    outb(IDE_CMD, IDE_CMD_READ);
+
+    for (; nsecs > 0; nsecs--, dst += SECTSIZE) {
+        if ((r = ide_wait_ready(1)) < 0) {
+            return r;
+        }
+        insl(IDE_DATA, dst, SECTSIZE / 4);
+    }
+    return 0;
+}
+
+int ide_write(int diskno, uint32_t secno, const void *src, size_t nsecs) {
+    int r;
+
+    ide_select(diskno, secno, nsecs);
+    outb(IDE_CMD, IDE_CMD_WRITE);
+
+    for (; nsecs > 0; nsecs--, src += SECTSIZE) {
+        if ((r = ide_wait_ready(1)) < 0) {
+            return r;
+        }
+        outsl(IDE_DATA, src, SECTSIZE / 4);
+    }
+    // the data is only safe once it is out of the drive's write cache
+    if ((r = ide_wait_ready(1)) < 0) {
+        return r;
+    }
+    outb(IDE_CMD, IDE_CMD_FLUSH);
+    return ide_wait_ready(1);
+}
@@ -0,0 +1,35 @@
+#ifndef _POTATOS_KERNEL_IDE_H_
+#define _POTATOS_KERNEL_IDE_H_
+#ifndef POS_KERNEL
+#error "This is a PotatOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+/**
+ * Minimal PIO driver for the disks on the primary IDE channel, polled,
+ * 28-bit LBA.  Disk 0 is the one we booted from; disk 1, if there is
+ * one, is the swap disk.
+ */
+
+#define SECTSIZE    512
+
+/**
+ * Ask disk diskno how big it is.
+ * @return  its size in sectors, or 0 if there is no such disk
+ */
+uint32_t ide_probe(int diskno);
+
+/**
+ * Read nsecs sectors from secno on.
+ * @return  0, or -E_IO
+ */
+int ide_read(int diskno, uint32_t secno, void *dst, size_t nsecs);
+
+/**
+ * Write nsecs sectors from secno on.
+ * @return  0, or -E_IO
+ */
+int ide_write(int diskno, uint32_t secno, const void *src, size_t nsecs);
+
+#endif  // !_POTATOS_KERNEL_IDE_H_
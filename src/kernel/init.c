@@ -1,13 +1,60 @@
+#include <inc/stdio.h>
+#include <inc/assert.h>
+
+#include <kernel/console.h>
+#include <kernel/boottime.h>
+#include <kernel/memmap.h>
+#include <kernel/pmap.h>
+#include <kernel/cow.h>
+#include <kernel/vm.h>
+#include <kernel/swap.h>
+#include <kernel/cpu.h>
+#include <kernel/monitor.h>
+
+struct CpuInfo cpus[NCPU];
+int ncpu = 1;
+
 
 // this is called by boot/main.c
-// after bootload has finished we start here
-void i386_init(void) {
-    extern char edata[], end[];
-
-    // Before doing anything else, complete the ELF loading process.
-    // Clear the uninitialized global data (BSS) section of our program.
-    // This ensures that all static/global variables start out zero.
-    memset(edata, 0, end - edata);
+// after bootload has finished we start here, with the loader's magic
+// number and info pointer (see entry.S)
+void i386_init(uint32_t magic, physaddr_t info) {
+    // The boot loader has already completed the ELF loading process,
+    // including clearing the uninitialized global data (BSS) section
+    // (as Multiboot loaders do too), so all static/global variables
+    // start out zero.
+
+    // Pick up the loader's boot timeline while its page is intact.
+    boottime_init();
+    memmap_init(magic, info);
+    boottime_mark("memmap_init");
+
+    // Initialize the console.
+    // Can't call cprintf until after we do this!
+    console_init();
+    boottime_mark("console_init");
+
+    memmap_print();
+
+    // Lab 2 memory management initialization functions
+    mem_init();
+    boottime_mark("mem_init");
+    console_remap();
+    boottime_mark("console_remap");
+    cow_init();
+    boottime_mark("cow_init");
+    vm_init();
+    boottime_mark("vm_init");
+    swap_init();
+    boottime_mark("swap_init");
+
+    // the whole timeline, now that every init has its mark
+    boottime_print();
+
+    // Drop into the kernel monitor.
+    while (1) {
+        monitor(NULL);
+    }
 }
 
 /**
@@ -20,12 +67,13 @@ static const char *panicstr;
  * Panic is called on unresolvable fatal errors.
  * It prints "panic: mesg", and then enters the kernel monitor.
  */
-/*void _panic(const char *file, int line, const char *fmt, ...) {
+void _panic(const char *file, int line, const char *fmt, ...) {
     va_list ap;
 
     if (panicstr) {
         goto dead;
     }
+    panicstr = fmt;
 
     // be extra sure that the machine is in a reasonable state
     __asm __volatile("cli; cld");
@@ -52,4 +100,3 @@ void _warn(const char *file, int line, const char *fmt, ...) {
     cprintf("\n");
     va_end(ap);
 }
-*/
@@ -0,0 +1,137 @@
+#include <inc/x86.h>
+#include <inc/mmu.h>
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <inc/assert.h>
+
+#include <kernel/kmap.h>
+#include <kernel/pmap.h>
+#include <kernel/cpu.h>
+
+struct Kmap_stats kmap_stats;
+
+// The PTEs of all the slots, KMAP_NSLOTS per CPU in cpus[] order
+static pte_t *kmap_ptes;
+
+static void check_kmap(void);
+
+// Map pa in the current CPU's next free slot.
+static void *kmap_pa(physaddr_t pa) {
+    int slot;
+    void *va;
+
+    assert(thiscpu->cpu_kmapdepth < KMAP_NSLOTS);
+    slot = cpunum() * KMAP_NSLOTS + thiscpu->cpu_kmapdepth++;
+    va = (void *) (KMAPBASE + slot * PGSIZE);
+
+    // the last kunmap() of this slot left its translation in the TLB
+    kmap_ptes[slot] = pa | PTE_P | PTE_W | pte_global;
+    invlpg(va);
+    return va;
+}
+
+void *kmap(struct Page *pp) {
+    if (!page_is_high(pp)) {
+        return page2kva(pp);
+    }
+    ++kmap_stats.km_maps;
+    return kmap_pa(page2pa(pp));
+}
+
+void kunmap(void *kva) {
+    uintptr_t va = (uintptr_t) kva;
+    int slot;
+
+    if (va < KMAPBASE || va >= KMAPBASE + KMAPSIZE) {
+        return;
+    }
+
+    slot = (va - KMAPBASE) / PGSIZE;
+    assert(thiscpu->cpu_kmapdepth > 0);
+    assert(slot == cpunum() * KMAP_NSLOTS + thiscpu->cpu_kmapdepth - 1);
+    --thiscpu->cpu_kmapdepth;
+    // no invlpg: the next kmap_pa() of the slot does it
+    kmap_ptes[slot] = 0;
+}
+
+void page_copy(struct Page *dst, struct Page *src) {
+    void *d = kmap(dst), *s = kmap(src);
+
+    memmove(d, s, PGSIZE);
+    kunmap(s);
+    kunmap(d);
+}
+
+void kmap_init(void) {
+    struct Page *pp;
+
+    static_assert(KMAP_NSLOTS > 0);
+    static_assert(KMAPBASE + KMAPSIZE <= KSTACKTOP - KSTKSIZE);
+
+    // Address spaces copy kern_pgdir's entries above UTOP when they are
+    // made, so the page table has to be there before the first one is.
+    assert(!(kern_pgdir[PDX(KMAPBASE)] & PTE_P));
+    if (!(pp = page_alloc(ALLOC_ZERO))) {
+        panic("kmap_init: out of memory");
+    }
+    pp->pp_ref = 1;
+    kern_pgdir[PDX(KMAPBASE)] = page2pa(pp) | PTE_P | PTE_W;
+    kmap_ptes = (pte_t *) page2kva(pp) + PTX(KMAPBASE);
+
+    check_kmap();
+}
+
+static void check_kmap(void) {
+    struct Page *pp0, *pp1, *hp;
+    char *p0, *p1, *q;
+    int depth = thiscpu->cpu_kmapdepth;
+
+    assert((pp0 = page_alloc(ALLOC_ZERO)));
+    assert((pp1 = page_alloc(0)));
+    p0 = page2kva(pp0);
+    p1 = page2kva(pp1);
+
+    // low pages need no slot
+    assert(kmap(pp0) == p0);
+    kunmap(p0);
+    assert(thiscpu->cpu_kmapdepth == depth);
+
+    // a slot aliases the page's direct mapping
+    q = kmap_pa(page2pa(pp0));
+    assert((uintptr_t) q >= KMAPBASE && (uintptr_t) q < KMAPBASE + KMAPSIZE);
+    strcpy(q, "kmap");
+    assert(strcmp(p0, "kmap") == 0);
+
+    // slots nest, and each kmap gets a fresh translation
+    memset(p1, 0, PGSIZE);
+    assert(kmap_pa(page2pa(pp1)) == q + PGSIZE);
+    assert(q[PGSIZE] == 0);
+    kunmap(q + PGSIZE);
+    kunmap(q);
+    assert(thiscpu->cpu_kmapdepth == depth);
+    assert(kmap_pa(page2pa(pp1)) == q && q[0] == 0);
+    kunmap(q);
+
+    page_copy(pp1, pp0);
+    assert(strcmp(p1, "kmap") == 0);
+
+    // a real high page, if this machine has any
+    // (not page_alloc(), which would rather hand out a pre-zeroed page)
+    if ((hp = pages_alloc(0, ALLOC_HIGH | ALLOC_ZERO)) && page_is_high(hp)) {
+        q = kmap(hp);
+        assert(q[0] == 0 && q[PGSIZE - 1] == 0);
+        kunmap(q);
+        page_copy(hp, pp0);
+        memset(p0, 0, PGSIZE);
+        page_copy(pp0, hp);
+        assert(strcmp(p0, "kmap") == 0);
+    }
+    if (hp) {
+        page_free(hp);
+    }
+    assert(thiscpu->cpu_kmapdepth == depth);
+
+    page_free(pp1);
+    page_free(pp0);
+    cprintf("check_kmap() succeeded!\n");
+}
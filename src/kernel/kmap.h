@@ -0,0 +1,58 @@
+#ifndef _POTATOS_KERNEL_KMAP_H_
+#define _POTATOS_KERNEL_KMAP_H_
+#ifndef POS_KERNEL
+#error "This is a PotatOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/memlayout.h>
+
+#include <kernel/cpu.h>
+
+/**
+ * High memory.  The kernel maps only the first 256MB of physical memory
+ * at KERNBASE (npages_low pages); the pages beyond that are allocated
+ * with ALLOC_HIGH and go to user space, which maps them like any other.
+ * When the kernel itself has to touch one -- to zero it, or copy it on
+ * a write fault -- it maps it for a moment in one of its CPU's kmap
+ * slots at KMAPBASE.
+ *
+ * Each CPU owns KMAP_NSLOTS slots, used as a stack: kunmap() has to undo
+ * the latest kmap() first.  Nothing else ever uses a CPU's slots, so
+ * taking one is a PTE write and an invlpg of that slot's stale
+ * translation, with no lock and no other CPU to tell.  Low pages need
+ * none of this: kmap() just returns their page2kva().
+ */
+
+#define KMAP_NSLOTS     (KMAPSIZE / PGSIZE / NCPU)
+
+struct Kmap_stats {
+    uint32_t km_maps;           // kmap()s that took a slot
+};
+
+extern struct Kmap_stats kmap_stats;
+
+/**
+ * Give the kernel an address for pp until the matching kunmap().
+ * @return  page2kva(pp) for a low page, a kmap slot for a high one
+ */
+void *kmap(struct Page *pp);
+
+/**
+ * Undo kmap().  kva must be the latest kmap() on this CPU not yet
+ * undone, unless it was a low page's.
+ */
+void kunmap(void *kva);
+
+/**
+ * Copy a page's contents to another, either of them maybe high.
+ */
+void page_copy(struct Page *dst, struct Page *src);
+
+/**
+ * Build the page table behind the kmap slots in kern_pgdir, which every
+ * address space shares, and check the slots.
+ */
+void kmap_init(void);
+
+#endif  // !_POTATOS_KERNEL_KMAP_H_
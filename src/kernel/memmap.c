@@ -0,0 +1,231 @@
+#include <inc/mmu.h>
+#include <inc/memlayout.h>
+#include <inc/bootinfo.h>
+#include <inc/multiboot.h>
+#include <inc/stdio.h>
+
+#include <kernel/memmap.h>
+
+// Until the kernel sets up its own page tables, only the physical memory
+// entry.S maps is reachable: [0, 4GB - KERNBASE), at KERNBASE.
+#define EARLYMAP    ((physaddr_t) -KERNBASE)
+
+// Physical addresses are 32 bits, so anything from here up is unusable.
+#define MEMMAP_TOP  0x100000000ULL
+
+// boot.S stores the E820 map by address; keep struct Bootinfo in step
+_Static_assert(offsetof(struct Bootinfo, bi_e820size) ==
+               BOOTINFO_E820SIZE - BOOTINFO, "bi_e820size moved");
+_Static_assert(offsetof(struct Bootinfo, bi_e820) ==
+               BOOTINFO_E820MAP - BOOTINFO, "bi_e820 moved");
+_Static_assert(sizeof(struct E820ent) == E820_ENTSIZE, "bad E820ent");
+_Static_assert(offsetof(struct Bootinfo, bi_a20) ==
+               BOOTINFO_A20 - BOOTINFO, "bi_a20 moved");
+
+struct Memregion memregions[MAXMEMREGIONS];
+int nmemregions;
+
+// The ranges as the loader reported them: unsorted, possibly
+// overlapping, clipped to MEMMAP_TOP and rounded to whole pages.
+#define MAXRANGES   (BOOTINFO_E820MAX + 8)
+static struct {
+    uint64_t base;
+    uint64_t end;
+    uint32_t type;
+} ranges[MAXRANGES];
+static int nranges;
+
+static const char *source;
+
+static const char *mr_names[] = {
+    [MR_USABLE]     = "usable",
+    [MR_ACPI]       = "ACPI",
+    [MR_NVS]        = "ACPI NVS",
+    [MR_RESERVED]   = "reserved",
+    [MR_BAD]        = "bad",
+};
+
+static void *early_kaddr(physaddr_t pa, size_t len) {
+    if (pa >= EARLYMAP || len > EARLYMAP - pa) {
+        return NULL;
+    }
+    return (void*) (KERNBASE + pa);
+}
+
+static uint32_t e820_type(uint32_t type) {
+    switch (type) {
+    case E820_RAM:  return MR_USABLE;
+    case E820_ACPI: return MR_ACPI;
+    case E820_NVS:  return MR_NVS;
+    case E820_BAD:  return MR_BAD;
+    default:        return MR_RESERVED;
+    }
+}
+
+static void addrange(uint64_t addr, uint64_t len, uint32_t type) {
+    uint64_t end = addr + len;
+
+    if (nranges == MAXRANGES || addr >= MEMMAP_TOP || end <= addr) {
+        return;
+    }
+    end = MIN(end, MEMMAP_TOP);
+
+    // Only whole pages of RAM are any use, but a partial page of
+    // anything else spoils the whole page.
+    if (type == MR_USABLE) {
+        addr = (addr + PGSIZE - 1) & ~(uint64_t) (PGSIZE - 1);
+        end &= ~(uint64_t) (PGSIZE - 1);
+    } else {
+        addr &= ~(uint64_t) (PGSIZE - 1);
+        end = (end + PGSIZE - 1) & ~(uint64_t) (PGSIZE - 1);
+    }
+    if (addr >= end) {
+        return;
+    }
+
+    ranges[nranges].base = addr;
+    ranges[nranges].end = end;
+    ranges[nranges].type = type;
+    ++nranges;
+}
+
+static void read_bootinfo(struct Bootinfo *bi) {
+    uint32_t i, n;
+
+    n = MIN(bi->bi_e820size / E820_ENTSIZE, (uint32_t) BOOTINFO_E820MAX);
+    for (i = 0; i < n; ++i) {
+        addrange(bi->bi_e820[i].e_addr, bi->bi_e820[i].e_len,
+                 e820_type(bi->bi_e820[i].e_type));
+    }
+    source = "BIOS E820";
+}
+
+static void read_multiboot(struct Multiboot_info *mi) {
+    struct Multiboot_mmap *mm;
+    uintptr_t p, end;
+
+    if ((mi->mi_flags & MULTIBOOT_INFO_MMAP)
+        && (mm = early_kaddr(mi->mi_mmap_addr, mi->mi_mmap_length))) {
+        p = (uintptr_t) mm;
+        end = p + mi->mi_mmap_length;
+        for (; p + sizeof(*mm) <= end; p += mm->mm_size + 4) {
+            mm = (struct Multiboot_mmap*) p;
+            addrange(mm->mm_addr, mm->mm_len, e820_type(mm->mm_type));
+        }
+        source = "Multiboot memory map";
+    } else if (mi->mi_flags & MULTIBOOT_INFO_MEMORY) {
+        addrange(0, mi->mi_mem_lower * 1024ULL, MR_USABLE);
+        addrange(EXTPHYSMEM, mi->mi_mem_upper * 1024ULL, MR_USABLE);
+        source = "Multiboot memory sizes";
+    }
+}
+
+/**
+ * Turn the raw ranges into memregions: cut the address space at every
+ * range boundary, give each piece the highest type of the ranges that
+ * cover it, and merge neighbours of the same type.
+ */
+static void build(void) {
+    uint64_t bounds[2 * MAXRANGES], b;
+    struct Memregion *last;
+    uint32_t type;
+    int i, j, nbounds = 0;
+
+    for (i = 0; i < nranges; ++i) {
+        bounds[nbounds++] = ranges[i].base;
+        bounds[nbounds++] = ranges[i].end;
+    }
+    // insertion sort: there are only a few dozen
+    for (i = 1; i < nbounds; ++i) {
+        b = bounds[i];
+        for (j = i; j > 0 && bounds[j - 1] > b; --j) {
+            bounds[j] = bounds[j - 1];
+        }
+        bounds[j] = b;
+    }
+
+    nmemregions = 0;
+    for (i = 0; i + 1 < nbounds; ++i) {
+        if (bounds[i] == bounds[i + 1]) {
+            continue;
+        }
+
+        type = 0;
+        for (j = 0; j < nranges; ++j) {
+            if (ranges[j].base <= bounds[i] && bounds[i + 1] <= ranges[j].end) {
+                type = MAX(type, ranges[j].type);
+            }
+        }
+        if (type == 0) {
+            continue;   // a hole nobody reported
+        }
+
+        if (nmemregions > 0) {
+            last = &memregions[nmemregions - 1];
+            if (last->mr_type == type && last->mr_base +
+                ((uint64_t) last->mr_npages << PGSHIFT) == bounds[i]) {
+                last->mr_npages += (bounds[i + 1] - bounds[i]) >> PGSHIFT;
+                continue;
+            }
+        }
+        if (nmemregions < MAXMEMREGIONS) {
+            memregions[nmemregions].mr_base = bounds[i];
+            memregions[nmemregions].mr_npages = (bounds[i + 1] - bounds[i]) >> PGSHIFT;
+            memregions[nmemregions].mr_type = type;
+            ++nmemregions;
+        }
+    }
+}
+
+void memmap_init(uint32_t magic, physaddr_t info) {
+    void *p;
+
+    nranges = 0;
+    if (magic == BOOTINFO_MAGIC && (p = early_kaddr(info, sizeof(struct Bootinfo)))) {
+        read_bootinfo(p);
+    } else if (magic == MULTIBOOT_BOOTLOADER_MAGIC
+               && (p = early_kaddr(info, sizeof(struct Multiboot_info)))) {
+        read_multiboot(p);
+    }
+
+    if (nranges == 0) {
+        // Nothing to go on (a BIOS without E820, say): assume just
+        // conventional memory and the 4MB that every PC we boot on has.
+        addrange(0, IOPHYSMEM, MR_USABLE);
+        addrange(EXTPHYSMEM, PTSIZE - EXTPHYSMEM, MR_USABLE);
+        source = "default";
+    }
+
+    // The ISA I/O hole is never RAM, whatever the firmware says.
+    addrange(IOPHYSMEM, EXTPHYSMEM - IOPHYSMEM, MR_RESERVED);
+
+    build();
+}
+
+ppn_t memmap_npages(void) {
+    int i;
+
+    for (i = nmemregions - 1; i >= 0; --i) {
+        if (memregions[i].mr_type == MR_USABLE) {
+            return PPN(memregions[i].mr_base) + memregions[i].mr_npages;
+        }
+    }
+    return 0;
+}
+
+void memmap_print(void) {
+    uint64_t usable = 0;
+    int i;
+
+    cprintf("physical memory map (%s):\n", source);
+    for (i = 0; i < nmemregions; ++i) {
+        cprintf("  [%08x-%08llx) %s\n", memregions[i].mr_base,
+                memregions[i].mr_base + ((uint64_t) memregions[i].mr_npages << PGSHIFT),
+                mr_names[memregions[i].mr_type]);
+        if (memregions[i].mr_type == MR_USABLE) {
+            usable += memregions[i].mr_npages;
+        }
+    }
+    cprintf("  %lluK usable, %u pages to cover\n",
+            usable * (PGSIZE / 1024), memmap_npages());
+}
@@ -0,0 +1,58 @@
+#ifndef _POTATOS_KERNEL_MEMMAP_H_
+#define _POTATOS_KERNEL_MEMMAP_H_
+#ifndef POS_KERNEL
+#error "This is a PotatOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+/**
+ * Physical memory map.  Built once at boot from whatever the loader
+ * handed over -- the E820 map our boot loader collects, or a Multiboot
+ * loader's memory map -- into a compact array of page-aligned regions,
+ * sorted by address, with no overlaps and adjacent regions of the same
+ * type merged.
+ */
+
+// Region types.  Where the firmware reports overlapping ranges the
+// higher type wins, so RAM is never handed out if anything else claims
+// it.
+#define MR_USABLE   1   // free RAM
+#define MR_ACPI     2   // ACPI tables; reclaimable once they are parsed
+#define MR_NVS      3   // ACPI non-volatile storage
+#define MR_RESERVED 4   // firmware, device memory, or unknown
+#define MR_BAD      5   // defective RAM
+
+#define MAXMEMREGIONS   64
+
+struct Memregion {
+    physaddr_t mr_base;
+    uint32_t mr_npages;
+    uint32_t mr_type;       // MR_*
+};
+
+extern struct Memregion memregions[];
+extern int nmemregions;
+
+/**
+ * Build memregions from the boot loader's information.  Must run before
+ * anything reuses low memory, where the information lives.
+ * @param magic  %eax at kernel entry: BOOTINFO_MAGIC or
+ *               MULTIBOOT_BOOTLOADER_MAGIC
+ * @param info   %ebx at kernel entry: physical address of the loader's
+ *               struct Bootinfo or struct Multiboot_info
+ */
+void memmap_init(uint32_t magic, physaddr_t info);
+
+/**
+ * @return  one more than the highest usable physical page number, which
+ *          is how many struct Page's it takes to cover all RAM
+ */
+ppn_t memmap_npages(void);
+
+/**
+ * Print the memory map on the console.
+ */
+void memmap_print(void);
+
+#endif  // !_POTATOS_KERNEL_MEMMAP_H_
@@ -0,0 +1,303 @@
+/**
+ * Simple command-line kernel monitor useful for
+ * controlling the kernel and exploring the system interactively.
+ */
+
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <inc/memlayout.h>
+
+#include <kernel/console.h>
+#include <kernel/monitor.h>
+#include <kernel/pmap.h>
+#include <kernel/cpu.h>
+#include <kernel/slab.h>
+#include <kernel/pagezero.h>
+#include <kernel/cow.h>
+#include <kernel/vm.h>
+#include <kernel/tlb.h>
+#include <kernel/kmap.h>
+#include <kernel/rmap.h>
+#include <kernel/swap.h>
+#include <kernel/zswap.h>
+
+#define CMDBUF_SIZE 80  // enough for one VGA text line
+
+struct Command {
+    const char *name;
+    const char *desc;
+    // return -1 to force monitor to exit
+    int (*func)(int argc, char **argv, struct Trapframe *tf);
+};
+
+static struct Command commands[] = {
+    { "help", "Display this list of commands", mon_help },
+    { "kerninfo", "Display information about the kernel", mon_kerninfo },
+    { "pagemag", "Show page magazine stats, or set them [low high]",
+      mon_pagemag },
+    { "slabinfo", "Show kernel object cache usage", mon_slabinfo },
+    { "pagezero", "Show pre-zeroed page pool stats, or set [target]",
+      mon_pagezero },
+    { "vmstat", "Show copy-on-write, 4MB page, high memory and rmap counters",
+      mon_vmstat },
+    { "tlbbench", "Time an address space switch with and without global "
+      "pages", mon_tlbbench },
+    { "tlbstat", "Show TLB flush counters, or set [ceiling]", mon_tlbstat },
+    { "colour", "Show page colouring counters, or [on|off|bench]",
+      mon_colour },
+    { "swap", "Show reclaim and swap counters, or set watermarks [low high]",
+      mon_swap },
+    { "zswap", "Show the compressed swap pool, or set its limit [pages]",
+      mon_zswap },
+};
+#define NCOMMANDS (sizeof(commands)/sizeof(commands[0]))
+
+/***** Implementations of basic kernel monitor commands *****/
+
+int mon_help(int argc, char **argv, struct Trapframe *tf) {
+    int i;
+
+    for (i = 0; i < NCOMMANDS; i++) {
+        cprintf("%s - %s\n", commands[i].name, commands[i].desc);
+    }
+    return 0;
+}
+
+int mon_kerninfo(int argc, char **argv, struct Trapframe *tf) {
+    extern char _start[], entry[], etext[], edata[], end[];
+
+    cprintf("Special kernel symbols:\n");
+    cprintf("  _start                  %08x (phys)\n", _start);
+    cprintf("  entry  %08x (virt)  %08x (phys)\n", entry, entry - KERNBASE);
+    cprintf("  etext  %08x (virt)  %08x (phys)\n", etext, etext - KERNBASE);
+    cprintf("  edata  %08x (virt)  %08x (phys)\n", edata, edata - KERNBASE);
+    cprintf("  end    %08x (virt)  %08x (phys)\n", end, end - KERNBASE);
+    cprintf("Kernel executable memory footprint: %dKB\n",
+            ROUNDUP(end - entry, 1024) / 1024);
+    return 0;
+}
+
+int mon_pagemag(int argc, char **argv, struct Trapframe *tf) {
+    struct Pagemag *pm;
+    int i;
+
+    if (argc == 3) {
+        if (pagemag_tune(strtol(argv[1], NULL, 0),
+                         strtol(argv[2], NULL, 0)) < 0) {
+            cprintf("need 0 < low <= high < %d\n", PAGEMAG_SIZE);
+            return 0;
+        }
+    } else if (argc != 1) {
+        cprintf("usage: pagemag [low high]\n");
+        return 0;
+    }
+
+    cprintf("watermarks: low %d, high %d\n", pagemag_low, pagemag_high);
+    for (i = 0; i < ncpu; i++) {
+        pm = &cpus[i].cpu_pagemag;
+        cprintf("cpu %d: %d pages; alloc %u hits %u misses; "
+                "free %u hits %u misses\n", i, pm->pm_count,
+                pm->pm_alloc_hits, pm->pm_alloc_misses,
+                pm->pm_free_hits, pm->pm_free_misses);
+    }
+    cprintf("buddy free blocks:");
+    for (i = 0; i <= PAGE_MAXORDER; i++) {
+        cprintf(" %u", page_nfree(i));
+    }
+    cprintf("\n");
+    return 0;
+}
+
+int mon_slabinfo(int argc, char **argv, struct Trapframe *tf) {
+    kmem_print();
+    return 0;
+}
+
+int mon_pagezero(int argc, char **argv, struct Trapframe *tf) {
+    struct Pagezero_stats *pz = &pagezero_stats;
+
+    if (argc == 2) {
+        pagezero_set_target(strtol(argv[1], NULL, 0));
+    } else if (argc != 1) {
+        cprintf("usage: pagezero [target]\n");
+        return 0;
+    }
+
+    cprintf("pool: %u of %u pages, zeroed with %s\n", pz->pz_count,
+            pz->pz_target, pz->pz_nt ? "movnti" : "rep stosl");
+    cprintf("ALLOC_ZERO: %u from the pool, %u zeroed on the spot; "
+            "%u zeroed at idle\n", pz->pz_hits, pz->pz_misses, pz->pz_zeroed);
+    return 0;
+}
+
+int mon_vmstat(int argc, char **argv, struct Trapframe *tf) {
+    cprintf("cow: %u pages shared, %u copied, %u reused on write\n",
+            cow_stats.cs_shared, cow_stats.cs_copied, cow_stats.cs_reused);
+    cprintf("4MB pages: %u mapped, %u fell back to 4KB pages\n",
+            vm_hugestats.vh_huge, vm_hugestats.vh_fallback);
+    cprintf("high memory: %u of %u pages free, %u kmaps\n",
+            page_nfree_high(), npages - npages_low, kmap_stats.km_maps);
+    cprintf("rmap: %u mappings tracked, %u pages unmapped everywhere\n",
+            rmap_stats.rs_live, rmap_stats.rs_unmap_all);
+    return 0;
+}
+
+int mon_tlbbench(int argc, char **argv, struct Trapframe *tf) {
+    tlb_bench();
+    return 0;
+}
+
+int mon_tlbstat(int argc, char **argv, struct Trapframe *tf) {
+    if (argc == 2) {
+        tlb_ceiling = strtol(argv[1], NULL, 0);
+    } else if (argc != 1) {
+        cprintf("usage: tlbstat [ceiling]\n");
+        return 0;
+    }
+
+    cprintf("ceiling: invlpg up to %u pages per batch\n", tlb_ceiling);
+    cprintf("%u batches: %u pages by invlpg, %u CR3 reloads\n",
+            tlb_stats.ts_batches, tlb_stats.ts_invlpg, tlb_stats.ts_full);
+    return 0;
+}
+
+int mon_colour(int argc, char **argv, struct Trapframe *tf) {
+    if (argc == 2 && strcmp(argv[1], "on") == 0) {
+        page_colouring = 1;
+    } else if (argc == 2 && strcmp(argv[1], "off") == 0) {
+        page_colouring = 0;
+        colour_drain();
+    } else if (argc == 2 && strcmp(argv[1], "bench") == 0) {
+        vm_colour_bench();
+        return 0;
+    } else if (argc != 1) {
+        cprintf("usage: colour [on|off|bench]\n");
+        return 0;
+    }
+
+    cprintf("colouring %s: %u colours, L2 %u-way with %u-byte lines\n",
+            page_colouring ? "on" : "off", page_ncolours, page_cache_ways,
+            page_cache_line);
+    cprintf("%u pages by colour, %u refills, %u of any colour\n",
+            colour_stats.cs_allocs, colour_stats.cs_refills,
+            colour_stats.cs_fallbacks);
+    return 0;
+}
+
+int mon_swap(int argc, char **argv, struct Trapframe *tf) {
+    if (argc == 3) {
+        if (reclaim_tune(strtol(argv[1], NULL, 0),
+                         strtol(argv[2], NULL, 0)) < 0) {
+            cprintf("need 0 < low <= high\n");
+            return 0;
+        }
+    } else if (argc != 1) {
+        cprintf("usage: swap [low high]\n");
+        return 0;
+    }
+
+    cprintf("watermarks: low %u, high %u free pages\n", reclaim_low,
+            reclaim_high);
+    cprintf("swap: %u of %u slots used\n", swap_nused, swap_nslots);
+    cprintf("%u pages scanned, %u referenced; %u zero pages dropped, "
+            "%u written to disk, %u read back; %u allocations failed, "
+            "%u backoffs\n",
+            swap_stats.sw_scans, swap_stats.sw_referenced,
+            swap_stats.sw_discards, swap_stats.sw_swapouts,
+            swap_stats.sw_swapins, swap_stats.sw_failed,
+            swap_stats.sw_backoffs);
+    return 0;
+}
+
+int mon_zswap(int argc, char **argv, struct Trapframe *tf) {
+    struct Zswap_stats *zs = &zswap_stats;
+    uint32_t slab;
+
+    if (argc == 2) {
+        zswap_maxpool = strtol(argv[1], NULL, 0);
+    } else if (argc != 1) {
+        cprintf("usage: zswap [pages]\n");
+        return 0;
+    }
+
+    slab = zswap_slab_pages() * PGSIZE;
+    cprintf("pool: %u pages in %uKB of slab (%uKB of objects, %uKB "
+            "compressed), limit %u pages%s\n", zs->zs_pages, slab / 1024,
+            zs->zs_pool / 1024, zs->zs_bytes / 1024, zswap_maxpool,
+            zswap_maxpool == 0 ? " (off)" : "");
+    if (slab > 0) {
+        cprintf("ratio: %u.%02u : 1\n", zs->zs_pages * PGSIZE / slab,
+                zs->zs_pages * PGSIZE % slab * 100 / slab);
+    }
+    cprintf("%u pages stored, %u did not compress enough, %u found the "
+            "pool full\n", zs->zs_stores, zs->zs_rejects, zs->zs_full);
+    cprintf("major faults: %u decompressed in %llu cycles each, "
+            "%u read from disk in %llu cycles each\n",
+            zs->zs_loads, zs->zs_loads ? zs->zs_load_cycles / zs->zs_loads : 0,
+            swap_stats.sw_swapins, swap_stats.sw_swapins ?
+            swap_stats.sw_read_cycles / swap_stats.sw_swapins : 0);
+    return 0;
+}
+
+/***** Kernel monitor command interpreter *****/
+
+#define WHITESPACE "\t\r\n "
+#define MAXARGS 16
+
+static int runcmd(char *buf, struct Trapframe *tf) {
+    int argc;
+    char *argv[MAXARGS];
+    int i;
+
+    // Parse the command buffer into whitespace-separated arguments
+    argc = 0;
+    argv[argc] = 0;
+    while (1) {
+        // gobble whitespace
+        while (*buf && strchr(WHITESPACE, *buf)) {
+            *buf++ = 0;
+        }
+        if (*buf == 0) {
+            break;
+        }
+
+        // save and scan past next arg
+        if (argc == MAXARGS-1) {
+            cprintf("Too many arguments (max %d)\n", MAXARGS);
+            return 0;
+        }
+        argv[argc++] = buf;
+        while (*buf && !strchr(WHITESPACE, *buf)) {
+            buf++;
+        }
+    }
+    argv[argc] = 0;
+
+    // Lookup and invoke the command
+    if (argc == 0) {
+        return 0;
+    }
+    for (i = 0; i < NCOMMANDS; i++) {
+        if (strcmp(argv[0], commands[i].name) == 0) {
+            return commands[i].func(argc, argv, tf);
+        }
+    }
+    cprintf("Unknown command '%s'\n", argv[0]);
+    return 0;
+}
+
+void monitor(struct Trapframe *tf) {
+    char *buf;
+
+    cprintf("Welcome to the PotatOS kernel monitor!\n");
+    cprintf("Type 'help' for a list of commands.\n");
+
+    while (1) {
+        buf = readline("K> ");
+        if (buf != NULL) {
+            if (runcmd(buf, tf) < 0) {
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef _POTATOS_KERNEL_MONITOR_H_
+#define _POTATOS_KERNEL_MONITOR_H_
+#ifndef POS_KERNEL
+#error "This is a PotatOS kernel header; user programs should not #include it"
+#endif
+
+struct Trapframe;
+
+/**
+ * Activate the kernel monitor, optionally providing a trap frame
+ * indicating the current state (NULL if none).
+ */
+void monitor(struct Trapframe *tf);
+
+// Functions implementing monitor commands.
+int mon_help(int argc, char **argv, struct Trapframe *tf);
+int mon_kerninfo(int argc, char **argv, struct Trapframe *tf);
+int mon_pagemag(int argc, char **argv, struct Trapframe *tf);
+int mon_slabinfo(int argc, char **argv, struct Trapframe *tf);
+int mon_pagezero(int argc, char **argv, struct Trapframe *tf);
+int mon_vmstat(int argc, char **argv, struct Trapframe *tf);
+int mon_tlbbench(int argc, char **argv, struct Trapframe *tf);
+int mon_tlbstat(int argc, char **argv, struct Trapframe *tf);
+int mon_colour(int argc, char **argv, struct Trapframe *tf);
+int mon_swap(int argc, char **argv, struct Trapframe *tf);
+int mon_zswap(int argc, char **argv, struct Trapframe *tf);
+
+#endif  // !_POTATOS_KERNEL_MONITOR_H_
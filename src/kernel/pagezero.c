@@ -0,0 +1,141 @@
+#include <inc/x86.h>
+#include <inc/mmu.h>
+#include <inc/assert.h>
+#include <inc/string.h>
+
+#include <kernel/pagezero.h>
+#include <kernel/pmap.h>
+#include <kernel/spinlock.h>
+
+struct Pagezero_stats pagezero_stats;
+
+static struct Page_list pagezero_pool;
+static struct spinlock pagezero_lock;
+
+static void check_pagezero(void);
+
+// Zero a page with cached stores.
+static void zero_stos(void *kva) {
+    uint32_t n = PGSIZE / 4;
+
+    __asm __volatile("cld; rep stosl"
+                     : "+D" (kva), "+c" (n)
+                     : "a" (0)
+                     : "memory", "cc");
+}
+
+// Zero a page with non-temporal stores, which bypass the caches.
+static void zero_movnti(void *kva) {
+    uint32_t *p, *end = (uint32_t *) kva + PGSIZE / 4;
+
+    for (p = kva; p < end; p += 4) {
+        __asm __volatile("movnti %1, 0(%0)\n\t"
+                         "movnti %1, 4(%0)\n\t"
+                         "movnti %1, 8(%0)\n\t"
+                         "movnti %1, 12(%0)"
+                         : : "r" (p), "r" (0) : "memory");
+    }
+    // make the stores visible before the page is handed out
+    __asm __volatile("sfence" : : : "memory");
+}
+
+void pagezero_init(void) {
+    uint32_t edx;
+
+    cpuid(1, NULL, NULL, NULL, &edx);
+    pagezero_stats.pz_nt = !!(edx & CPUID_SSE2);
+    pagezero_stats.pz_target = MIN(PAGEZERO_TARGET, npages / 16);
+
+    spin_initlock(&pagezero_lock);
+    LIST_INIT(&pagezero_pool);
+
+    check_pagezero();
+}
+
+struct Page *pagezero_get(void) {
+    struct Page *pp;
+
+    spin_lock(&pagezero_lock);
+    if ((pp = LIST_FIRST(&pagezero_pool)) != NULL) {
+        LIST_REMOVE(pp, pp_link);
+        --pagezero_stats.pz_count;
+    }
+    spin_unlock(&pagezero_lock);
+    return pp;
+}
+
+void pagezero_sync(struct Page *pp) {
+    zero_stos(page2kva(pp));
+}
+
+int pagezero_idle(void) {
+    struct Page *pp;
+    int n;
+
+    for (n = 0; n < PAGEZERO_BATCH; ++n) {
+        if (pagezero_stats.pz_count >= pagezero_stats.pz_target) {
+            break;
+        }
+        // not page_alloc(): that would dip into the pool when short
+        if ((pp = pages_alloc(0, 0)) == NULL) {
+            break;
+        }
+
+        if (pagezero_stats.pz_nt) {
+            zero_movnti(page2kva(pp));
+        } else {
+            zero_stos(page2kva(pp));
+        }
+
+        spin_lock(&pagezero_lock);
+        LIST_INSERT_HEAD(&pagezero_pool, pp, pp_link);
+        ++pagezero_stats.pz_count;
+        ++pagezero_stats.pz_zeroed;
+        spin_unlock(&pagezero_lock);
+    }
+    return n;
+}
+
+void pagezero_set_target(uint32_t target) {
+    struct Page *pp;
+
+    pagezero_stats.pz_target = MIN(target, npages / 16);
+    while (pagezero_stats.pz_count > pagezero_stats.pz_target &&
+           (pp = pagezero_get()) != NULL) {
+        pages_free(pp, 0);
+    }
+}
+
+/**
+ * Check that the idle loop fills the pool with zeroed pages, and that
+ * page_alloc(ALLOC_ZERO) takes them from there.
+ */
+static void check_pagezero(void) {
+    struct Page *pp;
+    uint32_t hits;
+    int i;
+
+    assert(pagezero_idle() == MIN(PAGEZERO_BATCH, pagezero_stats.pz_target));
+    assert(pagezero_stats.pz_count > 0);
+
+    hits = pagezero_stats.pz_hits;
+    assert((pp = page_alloc(ALLOC_ZERO)));
+    assert(pagezero_stats.pz_hits == hits + 1);
+    for (i = 0; i < PGSIZE; ++i) {
+        assert(((char *) page2kva(pp))[i] == 0);
+    }
+    memset(page2kva(pp), 0xcc, PGSIZE);
+    page_free(pp);
+
+    // without the pool, the page is zeroed on the spot
+    pagezero_set_target(0);
+    assert(pagezero_stats.pz_count == 0);
+    assert((pp = page_alloc(ALLOC_ZERO)));
+    for (i = 0; i < PGSIZE; ++i) {
+        assert(((char *) page2kva(pp))[i] == 0);
+    }
+    page_free(pp);
+    pagezero_set_target(PAGEZERO_TARGET);
+
+    cprintf("check_pagezero() succeeded!\n");
+}
@@ -0,0 +1,64 @@
+#ifndef _POTATOS_KERNEL_PAGEZERO_H_
+#define _POTATOS_KERNEL_PAGEZERO_H_
+#ifndef POS_KERNEL
+#error "This is a PotatOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/memlayout.h>
+
+/**
+ * Pool of pre-zeroed pages.  The idle loop takes free pages, zeroes
+ * them and parks them here, so that page_alloc(ALLOC_ZERO) -- a fresh
+ * page for user memory, or a page table -- usually finds one ready
+ * instead of clearing 4KB on the spot.  The background zeroing uses
+ * non-temporal stores (movnti) when the CPU has SSE2, so it does not
+ * push anything useful out of the caches.
+ */
+
+// Pool size to aim for, in pages; never more than 1/16 of memory
+#define PAGEZERO_TARGET 256
+// Pages pagezero_idle() zeroes per call
+#define PAGEZERO_BATCH  8
+
+struct Pagezero_stats {
+    uint32_t pz_count;          // pages in the pool
+    uint32_t pz_target;
+    uint32_t pz_hits;           // ALLOC_ZERO allocations served from it
+    uint32_t pz_misses;         // ... zeroed synchronously instead
+    uint32_t pz_zeroed;         // pages zeroed at idle
+    bool pz_nt;                 // background zeroing uses movnti
+};
+
+extern struct Pagezero_stats pagezero_stats;
+
+/**
+ * Set up the pool, empty.  Needs the page allocator.
+ */
+void pagezero_init(void);
+
+/**
+ * Take a page out of the pool.
+ * @return  a zeroed page, or NULL if the pool is empty
+ */
+struct Page *pagezero_get(void);
+
+/**
+ * Zero a page on the spot, with ordinary (cached) stores: it is about
+ * to be used.
+ */
+void pagezero_sync(struct Page *pp);
+
+/**
+ * Top the pool up by at most PAGEZERO_BATCH pages.  Called whenever the
+ * kernel has nothing better to do.
+ * @return  number of pages zeroed
+ */
+int pagezero_idle(void);
+
+/**
+ * Change the pool target, giving back pages above it.
+ */
+void pagezero_set_target(uint32_t target);
+
+#endif  // !_POTATOS_KERNEL_PAGEZERO_H_
@@ -0,0 +1,122 @@
+#include <inc/x86.h>
+#include <inc/mmu.h>
+#include <inc/memlayout.h>
+#include <inc/stdio.h>
+#include <inc/assert.h>
+
+#include <kernel/pat.h>
+#include <kernel/pmap.h>
+#include <kernel/memmap.h>
+
+// Memory type encodings in the PAT MSR
+#define PAT_UC      0x00
+#define PAT_WC      0x01
+#define PAT_WT      0x04
+#define PAT_WB      0x06
+#define PAT_UCMINUS 0x07
+
+#define PAT_ENTRY(i, type)  ((uint64_t) (type) << ((i) * 8))
+
+// The table in pat.h, with entries 4 to 7 repeating 0 to 3 except WT
+// in 5
+#define PAT_VALUE   (PAT_ENTRY(0, PAT_WB) | PAT_ENTRY(1, PAT_WC) |        \
+                     PAT_ENTRY(2, PAT_UCMINUS) | PAT_ENTRY(3, PAT_UC) |   \
+                     PAT_ENTRY(4, PAT_WB) | PAT_ENTRY(5, PAT_WT) |        \
+                     PAT_ENTRY(6, PAT_UCMINUS) | PAT_ENTRY(7, PAT_UC))
+
+bool pat_enabled;
+
+// next free address in the MMIO window
+static uintptr_t mmio_next = MMIOBASE;
+
+static void check_pat(void);
+
+pte_t pat_pte(int mtype) {
+    switch (mtype) {
+    case MT_WB:
+        return 0;
+    case MT_WT:
+        return pat_enabled ? PTE_PAT | PTE_PWT : PTE_PWT;
+    case MT_WC:
+        return pat_enabled ? PTE_PWT : PTE_PCD;
+    case MT_UC:
+        return PTE_PCD | PTE_PWT;
+    default:
+        panic("pat_pte: bad memory type %d", mtype);
+    }
+}
+
+// Whether any of [start, end) is usable RAM.
+static bool is_ram(physaddr_t start, physaddr_t end) {
+    physaddr_t base;
+    int i;
+
+    for (i = 0; i < nmemregions; ++i) {
+        base = memregions[i].mr_base;
+        if (memregions[i].mr_type == MR_USABLE && base < end
+            && start < base + ((uint64_t) memregions[i].mr_npages << PGSHIFT)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void *mmio_map_region(physaddr_t pa, size_t size, int mtype) {
+    physaddr_t start = ROUNDDOWN(pa, PGSIZE);
+    physaddr_t end = ROUNDUP(pa + size, PGSIZE);
+    uintptr_t va = mmio_next;
+    pte_t *pte;
+
+    if (end - start > MMIOLIM - mmio_next) {
+        panic("mmio_map_region: out of MMIO space mapping %08x", pa);
+    }
+    if (mtype != MT_WB && is_ram(start, end)) {
+        panic("mmio_map_region: %08x is RAM", pa);
+    }
+
+    for (; start < end; start += PGSIZE, mmio_next += PGSIZE) {
+        // the kmap page table covers the window too
+        pte = pgdir_walk(kern_pgdir, (void *) mmio_next, 0);
+        assert(pte && !(*pte & PTE_P));
+        *pte = start | PTE_P | PTE_W | pte_global | pat_pte(mtype);
+    }
+    return (void *) (va + PGOFF(pa));
+}
+
+void pat_init(void) {
+    uint32_t edx;
+
+    cpuid(1, NULL, NULL, NULL, &edx);
+    if (edx & CPUID_PAT) {
+        // Nothing is mapped with entries 1 or 5 yet, so nothing cached
+        // can be of the wrong type, but be as careful as the manuals ask.
+        wbinvd();
+        wrmsr(MSR_PAT, PAT_VALUE);
+        tlbflush_all();
+        pat_enabled = 1;
+    }
+    check_pat();
+}
+
+// The PAT entry a PTE's bits select
+static int pat_index(pte_t pte) {
+    return ((pte & PTE_PAT) ? 4 : 0) | ((pte & PTE_PCD) ? 2 : 0)
+        | ((pte & PTE_PWT) ? 1 : 0);
+}
+
+static void check_pat(void) {
+    uint64_t pat;
+
+    if (!pat_enabled) {
+        cprintf("check_pat() skipped: no PAT\n");
+        return;
+    }
+
+    pat = rdmsr(MSR_PAT);
+    assert(pat == PAT_VALUE);
+    assert(((pat >> (pat_index(pat_pte(MT_WB)) * 8)) & 0xff) == PAT_WB);
+    assert(((pat >> (pat_index(pat_pte(MT_WT)) * 8)) & 0xff) == PAT_WT);
+    assert(((pat >> (pat_index(pat_pte(MT_WC)) * 8)) & 0xff) == PAT_WC);
+    assert(((pat >> (pat_index(pat_pte(MT_UC)) * 8)) & 0xff) == PAT_UC);
+    cprintf("check_pat() succeeded!\n");
+}
@@ -0,0 +1,59 @@
+#ifndef _POTATOS_KERNEL_PAT_H_
+#define _POTATOS_KERNEL_PAT_H_
+#ifndef POS_KERNEL
+#error "This is a PotatOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/mmu.h>
+
+/**
+ * Memory types.  A PTE picks one of the eight entries of the Page
+ * Attribute Table with its PTE_PAT, PTE_PCD and PTE_PWT bits; pat_init()
+ * programs the table so that every type below has an entry:
+ *
+ *   PAT PCD PWT   entry   type
+ *    0   0   0      0     WB   (what everything else is mapped as)
+ *    0   0   1      1     WC   (power-on default: WT)
+ *    0   1   0      2     UC-
+ *    0   1   1      3     UC
+ *    1   0   1      5     WT
+ *
+ * Entries 0, 2 and 3 keep their power-on values, so a CPU without a PAT
+ * still gets WB and UC right.  It has no WC, though: WC mappings fall
+ * back to UC-, which lets the MTRRs make them WC where the firmware set
+ * that up, and WT to plain PTE_PWT.
+ */
+enum {
+    MT_WB,      // write-back: RAM
+    MT_WT,      // write-through
+    MT_WC,      // write-combining: framebuffers
+    MT_UC,      // uncached, strongly ordered: device registers
+};
+
+// whether the CPU has a PAT, and pat_init() programmed it
+extern bool pat_enabled;
+
+/**
+ * @return  the PTE_PAT, PTE_PCD and PTE_PWT bits that map a page as
+ *          mtype
+ */
+pte_t pat_pte(int mtype);
+
+/**
+ * Map device memory [pa, pa + size) in the MMIO window with memory type
+ * mtype.  pa and size need not be page aligned.  Mappings are for good:
+ * there is no unmapping.  Panics if the window is full, or if the range
+ * is RAM, which is mapped write-back at KERNBASE and must not be mapped
+ * as anything else.
+ * @return  the kernel virtual address of pa
+ */
+void *mmio_map_region(physaddr_t pa, size_t size, int mtype);
+
+/**
+ * Program this CPU's PAT.  Every CPU needs it, before it maps anything
+ * with a memory type other than WB.
+ */
+void pat_init(void);
+
+#endif  // !_POTATOS_KERNEL_PAT_H_
@@ -0,0 +1,998 @@
+#include <inc/x86.h>
+#include <inc/mmu.h>
+#include <inc/memlayout.h>
+#include <inc/stdio.h>
+#include <inc/error.h>
+#include <inc/string.h>
+
+#include <kernel/pmap.h>
+#include <kernel/memmap.h>
+#include <kernel/cpu.h>
+#include <kernel/spinlock.h>
+#include <kernel/pagezero.h>
+#include <kernel/tlb.h>
+#include <kernel/ptwalk.h>
+#include <kernel/kmap.h>
+#include <kernel/pat.h>
+#include <kernel/rmap.h>
+#include <kernel/slab.h>
+#include <kernel/swap.h>
+
+// set by entry.S
+pte_t pte_global;
+
+// Kernel's initial page directory
+pde_t *kern_pgdir;
+extern pde_t entry_pgdir[NPDENTRIES];   // entrypgdir.c
+
+// Physical memory
+struct Page *pages;             // physical page state array
+size_t npages;                  // amount of physical memory (in pages)
+size_t npages_low;              // how much of it is mapped at KERNBASE
+
+// The buddy allocator keeps low memory, which the kernel can reach
+// through KERNBASE, and high memory, which it can't, in separate zones,
+// so that kernel allocations never get a high page.
+#define ZONE_LOW    0
+#define ZONE_HIGH   1
+#define NZONES      2
+
+#define page_zone(ppn)  ((ppn) < npages_low ? ZONE_LOW : ZONE_HIGH)
+
+// The buddy allocator's free lists, one per zone and block order, and
+// how many blocks each holds.
+static struct Page_list page_free_area[NZONES][PAGE_MAXORDER + 1];
+static size_t page_free_count[NZONES][PAGE_MAXORDER + 1];
+static struct spinlock page_lock;
+
+// Per-CPU magazine watermarks; see pmap.h
+int pagemag_low = 16;
+int pagemag_high = 64;
+
+// Page colouring; see pmap.h
+uint32_t page_ncolours = 1;
+uint32_t page_cache_ways, page_cache_line;
+bool page_colouring;
+struct Colour_stats colour_stats;
+
+// Free pages sorted by colour, for page_alloc_colour().  Not PP_FREE:
+// to the buddy allocator they are allocated.
+static struct Page_list colour_free[PAGE_MAXCOLOURS];
+static int colour_nfree[PAGE_MAXCOLOURS];
+static int colour_order;        // log2(page_ncolours)
+
+static struct Page *buddy_alloc(int zone, int order);
+static void buddy_free(struct Page *pp, int order);
+static void check_page_alloc(void);
+static void check_pagemag(void);
+static void check_colour(void);
+static void check_page(void);
+
+
+/**
+ * This simple physical memory allocator is used only while the kernel
+ * is setting up its memory management.  page_alloc() is the real
+ * allocator.
+ *
+ * If n>0, allocates enough pages of contiguous physical memory to hold
+ * 'n' bytes.  Doesn't initialize the memory.  Returns a kernel virtual
+ * address.
+ *
+ * If n==0, returns the address of the next free page without allocating
+ * anything.
+ *
+ * This function may ONLY be used during initialization, before the
+ * page_free_area lists have been set up.
+ */
+static void *boot_alloc(uint32_t n) {
+    static char *nextfree;  // virtual address of next byte of free memory
+    extern char end[];      // first byte past the kernel's BSS (kernel.ld)
+    char *result;
+
+    if (!nextfree) {
+        nextfree = ROUNDUP((char *) end, PGSIZE);
+    }
+
+    result = nextfree;
+    nextfree = ROUNDUP(nextfree + n, PGSIZE);
+    if (PPN(PADDR(nextfree)) > npages_low) {
+        panic("boot_alloc: out of memory");
+    }
+    return result;
+}
+
+/**
+ * Set up the physical page allocator: size the pages array from the
+ * memory map (memmap_init() must have run), allocate it, and hand every
+ * free page to the buddy allocator.
+ */
+void mem_init(void) {
+    int order;
+
+    // Only what entry.S maps at KERNBASE is directly reachable; the rest
+    // is high memory.
+    npages = memmap_npages();
+    npages_low = MIN(npages, PPN((physaddr_t) -KERNBASE));
+
+    pages = boot_alloc(npages * sizeof(struct Page));
+    memset(pages, 0, npages * sizeof(struct Page));
+
+    spin_initlock(&page_lock);
+    page_init();
+    check_page_alloc();
+    check_pagemag();
+    pagezero_init();
+
+    // entry.S's page directory already maps all of kernel space, so it
+    // stays on as the kernel's own.  Give it the usual recursive
+    // mapping of its page tables at VPT.
+    kern_pgdir = entry_pgdir;
+    kern_pgdir[PDX(VPT)] = PADDR(kern_pgdir) | PTE_W | PTE_P;
+    kmap_init();
+    pat_init();
+    // page_insert() needs rmap_init(), which needs the slab allocator
+    kmem_init();
+    rmap_init();
+    check_page();
+    tlb_init();
+    ptwalk_init();
+    colour_init();
+
+    cprintf("pages: %u (%u high), free blocks by order:", npages,
+            npages - npages_low);
+    for (order = 0; order <= PAGE_MAXORDER; ++order) {
+        cprintf(" %u", page_nfree(order));
+    }
+    cprintf("\n");
+}
+
+
+/**
+ * Buddy allocator.
+ *
+ * Free memory is kept as blocks of 2^order pages, each aligned to its
+ * own size, on one list per zone and order.  A block's buddy is the block of the
+ * same order it was split from, which is at page index (i ^ 2^order), so
+ * freeing a block merges it with its buddy -- and the result with its
+ * buddy, and so on -- in at most PAGE_MAXORDER steps.  Allocating splits
+ * the smallest big enough free block down to size, just as quickly.
+ * The zone boundary is 256MB, far above the biggest block, so no block
+ * or buddy ever straddles it.
+ */
+
+static void free_area_insert(struct Page *pp, int order) {
+    int zone = page_zone(pp - pages);
+
+    pp->pp_flags |= PP_FREE;
+    pp->pp_order = order;
+    LIST_INSERT_HEAD(&page_free_area[zone][order], pp, pp_link);
+    ++page_free_count[zone][order];
+}
+
+static void free_area_remove(struct Page *pp, int order) {
+    LIST_REMOVE(pp, pp_link);
+    pp->pp_link.le_next = NULL;
+    pp->pp_link.le_prev = NULL;
+    pp->pp_flags &= ~PP_FREE;
+    --page_free_count[page_zone(pp - pages)][order];
+}
+
+// Free the pages [start, end) as the largest aligned blocks that fit.
+static void free_range(ppn_t start, ppn_t end) {
+    int order;
+
+    while (start < end) {
+        for (order = PAGE_MAXORDER; order > 0; --order) {
+            if ((start & ((1 << order) - 1)) == 0 && start + (1 << order) <= end) {
+                break;
+            }
+        }
+        buddy_free(&pages[start], order);
+        start += 1 << order;
+    }
+}
+
+/**
+ * Hand all free physical memory to the buddy allocator: every usable
+ * page in the memory map except
+ *  1) page 0, which holds the real-mode IDT and BIOS structures, in
+ *     case we ever need them;
+ *  2) the kernel image, and what boot_alloc has handed out after it.
+ * The IO hole [IOPHYSMEM, EXTPHYSMEM) is never usable in the memory map.
+ */
+void page_init(void) {
+    ppn_t start, end, kern_start, kern_end;
+    int i, zone;
+
+    for (zone = 0; zone < NZONES; ++zone) {
+        for (i = 0; i <= PAGE_MAXORDER; ++i) {
+            LIST_INIT(&page_free_area[zone][i]);
+        }
+    }
+
+    kern_start = PPN(EXTPHYSMEM);
+    kern_end = PPN(PADDR(boot_alloc(0)));
+
+    for (i = 0; i < nmemregions; ++i) {
+        if (memregions[i].mr_type != MR_USABLE) {
+            continue;
+        }
+        start = MAX(PPN(memregions[i].mr_base), (ppn_t) 1);
+        end = MIN(PPN(memregions[i].mr_base) + memregions[i].mr_npages, npages);
+
+        if (start < kern_end && end > kern_start) {
+            free_range(start, MIN(end, kern_start));
+            free_range(MAX(start, kern_end), end);
+        } else {
+            free_range(start, end);
+        }
+    }
+}
+
+// Allocate a block of 2^order pages from a zone.  Caller holds
+// page_lock.
+static struct Page *buddy_alloc(int zone, int order) {
+    struct Page *pp, *buddy;
+    int o;
+
+    // smallest free block that is big enough
+    for (o = order; o <= PAGE_MAXORDER; ++o) {
+        if (!LIST_EMPTY(&page_free_area[zone][o])) {
+            break;
+        }
+    }
+    if (o > PAGE_MAXORDER) {
+        return NULL;
+    }
+
+    pp = LIST_FIRST(&page_free_area[zone][o]);
+    free_area_remove(pp, o);
+
+    // give back the upper half until it is the right size
+    while (o > order) {
+        --o;
+        buddy = pp + (1 << o);
+        free_area_insert(buddy, o);
+    }
+    pp->pp_order = order;
+    return pp;
+}
+
+// Free a block of 2^order pages.  Caller holds page_lock.
+static void buddy_free(struct Page *pp, int order) {
+    struct Page *buddy;
+    ppn_t ppn = pp - pages;
+
+    assert(pp->pp_ref == 0 && !(pp->pp_flags & PP_FREE));
+    assert((ppn & ((1 << order) - 1)) == 0);
+
+    while (order < PAGE_MAXORDER) {
+        if ((ppn ^ (1 << order)) + (1 << order) > npages) {
+            break;
+        }
+        buddy = &pages[ppn ^ (1 << order)];
+        if (!(buddy->pp_flags & PP_FREE) || buddy->pp_order != order) {
+            break;
+        }
+        free_area_remove(buddy, order);
+        ppn &= ~(1 << order);
+        ++order;
+    }
+
+    free_area_insert(&pages[ppn], order);
+}
+
+// Zero a block of 2^order pages, which may be high memory.
+static void pages_zero(struct Page *pp, int order) {
+    void *kva;
+    int i;
+
+    if (!page_is_high(pp)) {
+        memset(page2kva(pp), 0, PGSIZE << order);
+        return;
+    }
+    for (i = 0; i < (1 << order); ++i) {
+        kva = kmap(pp + i);
+        memset(kva, 0, PGSIZE);
+        kunmap(kva);
+    }
+}
+
+struct Page *pages_alloc(int order, int alloc_flags) {
+    struct Page *pp = NULL;
+
+    if (order < 0 || order > PAGE_MAXORDER) {
+        return NULL;
+    }
+
+    spin_lock(&page_lock);
+    if (alloc_flags & ALLOC_HIGH) {
+        pp = buddy_alloc(ZONE_HIGH, order);
+    }
+    if (!pp) {
+        pp = buddy_alloc(ZONE_LOW, order);
+    }
+    spin_unlock(&page_lock);
+
+    if (pp && (alloc_flags & ALLOC_ZERO)) {
+        pages_zero(pp, order);
+    }
+    return pp;
+}
+
+void pages_free(struct Page *pp, int order) {
+    pp->pp_flags &= ~PP_ZEROFILL;
+    spin_lock(&page_lock);
+    buddy_free(pp, order);
+    spin_unlock(&page_lock);
+}
+
+size_t page_nfree(int order) {
+    return page_free_count[ZONE_LOW][order] + page_free_count[ZONE_HIGH][order];
+}
+
+size_t page_nfree_high(void) {
+    size_t n = 0;
+    int order;
+
+    for (order = 0; order <= PAGE_MAXORDER; ++order) {
+        n += page_free_count[ZONE_HIGH][order] << order;
+    }
+    return n;
+}
+
+/**
+ * Allocates a physical page.  If (alloc_flags & ALLOC_ZERO), fills the
+ * entire returned physical page with '\0' bytes, or rather takes one
+ * the idle loop already filled (see pagezero.h).  If (alloc_flags &
+ * ALLOC_HIGH), a high memory page is taken first if there is one, after
+ * any pre-zeroed page for ALLOC_ZERO; high pages bypass the magazines,
+ * which hold only low pages.  Does NOT increment the
+ * reference count of the page - the caller must do these if necessary
+ * (either explicitly or via page_insert).
+ *
+ * Returns NULL if out of free memory.
+ */
+struct Page *page_alloc(int alloc_flags) {
+    struct Pagemag *pm = &thiscpu->cpu_pagemag;
+    struct Page *pp;
+
+    // a page zeroed at idle beats zeroing a high one through kmap
+    if (alloc_flags & ALLOC_ZERO) {
+        if ((pp = pagezero_get()) != NULL) {
+            ++pagezero_stats.pz_hits;
+            return pp;
+        }
+        ++pagezero_stats.pz_misses;
+    }
+
+    if ((alloc_flags & ALLOC_HIGH) && page_nfree_high() > 0
+        && (pp = pages_alloc(0, alloc_flags)) != NULL) {
+        return pp;
+    }
+
+    if (pm->pm_count > 0) {
+        ++pm->pm_alloc_hits;
+    } else {
+        ++pm->pm_alloc_misses;
+        spin_lock(&page_lock);
+        while (pm->pm_count < pagemag_low && (pp = buddy_alloc(ZONE_LOW, 0))) {
+            pm->pm_pages[pm->pm_count++] = pp;
+        }
+        spin_unlock(&page_lock);
+        if (pm->pm_count == 0) {
+            // last resort: the pre-zeroed pages are free memory too
+            return pagezero_get();
+        }
+    }
+
+    pp = pm->pm_pages[--pm->pm_count];
+    if (alloc_flags & ALLOC_ZERO) {
+        pagezero_sync(pp);
+    }
+    return pp;
+}
+
+/**
+ * Return a page to the free list.
+ * (This function should only be called when pp->pp_ref reaches 0.)
+ */
+void page_free(struct Page *pp) {
+    struct Pagemag *pm = &thiscpu->cpu_pagemag;
+
+    assert(pp->pp_ref == 0 && !(pp->pp_flags & PP_FREE));
+    pp->pp_flags &= ~PP_ZEROFILL;
+
+    if (page_is_high(pp)) {
+        pages_free(pp, 0);
+        return;
+    }
+
+    pm->pm_pages[pm->pm_count++] = pp;
+    if (pm->pm_count <= pagemag_high) {
+        ++pm->pm_free_hits;
+        return;
+    }
+
+    ++pm->pm_free_misses;
+    spin_lock(&page_lock);
+    while (pm->pm_count > pagemag_low) {
+        buddy_free(pm->pm_pages[--pm->pm_count], 0);
+    }
+    spin_unlock(&page_lock);
+}
+
+void pagemag_drain(struct Pagemag *pm) {
+    spin_lock(&page_lock);
+    while (pm->pm_count > 0) {
+        buddy_free(pm->pm_pages[--pm->pm_count], 0);
+    }
+    spin_unlock(&page_lock);
+}
+
+int pagemag_tune(int low, int high) {
+    if (low <= 0 || low > high || high >= PAGEMAG_SIZE) {
+        return -1;
+    }
+    pagemag_low = low;
+    pagemag_high = high;
+    pagemag_drain(&thiscpu->cpu_pagemag);
+    return 0;
+}
+
+/**
+ * Page colouring.
+ *
+ * A page's colour is which slice of the L2 cache's sets its lines map
+ * to: its page number modulo the number of pages in one way of the
+ * cache.  Pages of different colours never compete for a set, so an
+ * address space given its pages in colour order can use all of the
+ * cache before any two of its pages evict each other.
+ *
+ * page_alloc_colour() keeps free pages in one bucket per colour.  An
+ * empty bucket is refilled by splitting a block of page_ncolours pages,
+ * one page of every colour, off the buddy allocator; the pages whose
+ * buckets are already full go straight back.
+ */
+
+// cpuid 0x80000006's L2 associativity field, in ways
+static const uint8_t l2_ways[16] = {
+    0, 1, 2, 0, 4, 0, 8, 0, 16, 0, 32, 48, 64, 96, 128, 0,
+};
+
+/**
+ * Count the colours from the L2 geometry cpuid reports.  A cache that
+ * cpuid does not describe, or a fully associative one, has one colour,
+ * which turns colouring off.
+ */
+void colour_init(void) {
+    uint32_t max, ecx, size;
+    int c;
+
+    cpuid(0x80000000, &max, NULL, NULL, NULL);
+    if (max >= 0x80000006) {
+        cpuid(0x80000006, NULL, NULL, &ecx, NULL);
+        size = (ecx >> 16) * 1024;
+        page_cache_ways = l2_ways[(ecx >> 12) & 0xf];
+        page_cache_line = ecx & 0xff;
+        if (page_cache_ways && size / page_cache_ways >= PGSIZE) {
+            page_ncolours = size / page_cache_ways / PGSIZE;
+        }
+    }
+
+    // a power of two, so that colours are page number bits
+    while (page_ncolours & (page_ncolours - 1)) {
+        page_ncolours &= page_ncolours - 1;
+    }
+    page_ncolours = MIN(page_ncolours, PAGE_MAXCOLOURS);
+    while ((1u << colour_order) < page_ncolours) {
+        ++colour_order;
+    }
+    for (c = 0; c < PAGE_MAXCOLOURS; ++c) {
+        LIST_INIT(&colour_free[c]);
+    }
+    check_colour();
+}
+
+struct Page *page_alloc_colour(int colour, int alloc_flags) {
+    struct Page *pp, *block = NULL;
+    int c, i;
+
+    colour &= page_ncolours - 1;
+    spin_lock(&page_lock);
+    if (LIST_EMPTY(&colour_free[colour])) {
+        ++colour_stats.cs_refills;
+        if (alloc_flags & ALLOC_HIGH) {
+            block = buddy_alloc(ZONE_HIGH, colour_order);
+        }
+        if (!block) {
+            block = buddy_alloc(ZONE_LOW, colour_order);
+        }
+        for (i = 0; block && i < (1 << colour_order); ++i) {
+            c = page_colour(block + i);
+            if (colour_nfree[c] < COLOUR_BUCKET_MAX) {
+                LIST_INSERT_HEAD(&colour_free[c], block + i, pp_link);
+                ++colour_nfree[c];
+            } else {
+                buddy_free(block + i, 0);
+            }
+        }
+    }
+    if ((pp = LIST_FIRST(&colour_free[colour])) != NULL) {
+        LIST_REMOVE(pp, pp_link);
+        --colour_nfree[colour];
+    }
+    spin_unlock(&page_lock);
+
+    if (!pp) {
+        // no block of page_ncolours pages left: any page will do
+        ++colour_stats.cs_fallbacks;
+        return page_alloc(alloc_flags);
+    }
+    ++colour_stats.cs_allocs;
+    pp->pp_order = 0;
+    if (alloc_flags & ALLOC_ZERO) {
+        pages_zero(pp, 0);
+    }
+    return pp;
+}
+
+size_t colour_nfree_total(void) {
+    size_t n = 0;
+    int c;
+
+    for (c = 0; c < PAGE_MAXCOLOURS; ++c) {
+        n += colour_nfree[c];
+    }
+    return n;
+}
+
+void colour_drain(void) {
+    struct Page *pp;
+    int c;
+
+    spin_lock(&page_lock);
+    for (c = 0; c < PAGE_MAXCOLOURS; ++c) {
+        while ((pp = LIST_FIRST(&colour_free[c])) != NULL) {
+            LIST_REMOVE(pp, pp_link);
+            --colour_nfree[c];
+            pp->pp_order = 0;
+            buddy_free(pp, 0);
+        }
+    }
+    spin_unlock(&page_lock);
+}
+
+/**
+ * Increment the reference count on a page, refusing to go past
+ * PP_REF_MAX: a page shared that widely must not wrap around to 0 and
+ * be freed under its users.
+ * @return  0, or -E_NO_MEM if the count is at PP_REF_MAX
+ */
+int page_incref(struct Page *pp) {
+    if (pp->pp_ref >= PP_REF_MAX) {
+        return -E_NO_MEM;
+    }
+    ++pp->pp_ref;
+    return 0;
+}
+
+/**
+ * Decrement the reference count on a page,
+ * freeing it if there are no more refs.
+ */
+void page_decref(struct Page *pp) {
+    if (--pp->pp_ref == 0) {
+        page_free(pp);
+    }
+}
+
+/**
+ * Given 'pgdir', a pointer to a page directory, pgdir_walk returns
+ * a pointer to the page table entry (PTE) for linear address 'va'.
+ * This requires walking the two-level page table structure.
+ *
+ * The relevant page table page might not exist yet.
+ * If this is true, and create == false, then pgdir_walk returns NULL.
+ * Otherwise, pgdir_walk allocates a new page table page with page_alloc,
+ * zeroed, and returns a pointer into it.  If the allocation fails,
+ * pgdir_walk returns NULL.
+ *
+ * If 'va' is covered by a 4MB page, pgdir_walk returns a pointer to its
+ * page directory entry, which the caller can tell by PTE_PS.
+ */
+pte_t *pgdir_walk(pde_t *pgdir, const void *va, int create) {
+    pde_t *pde = &pgdir[PDX(va)];
+    struct Page *pp;
+
+    if (!(*pde & PTE_P)) {
+        if (!create || !(pp = page_alloc(ALLOC_ZERO))) {
+            return NULL;
+        }
+        pp->pp_ref = 1;
+        // permissive: the PTEs decide
+        *pde = page2pa(pp) | PTE_P | PTE_W | PTE_U;
+    } else if (*pde & PTE_PS) {
+        return (pte_t *) pde;
+    }
+    return (pte_t *) KADDR(PTE_ADDR(*pde)) + PTX(va);
+}
+
+/**
+ * Map the physical page 'pp' at virtual address 'va'.
+ * The permissions (the low 12 bits) of the page table entry
+ * should be set to 'perm|PTE_P'.
+ *
+ * Requirements
+ *   - If there is already a page mapped at 'va', it should be
+ *     page_remove()d.
+ *   - If necessary, on demand, a page table should be allocated and
+ *     inserted into 'pgdir'.
+ *   - pp->pp_ref should be incremented if the insertion succeeds.
+ *   - The TLB must be invalidated if a page was formerly present at 'va'.
+ *
+ * Corner-case hint: re-inserting the same pp at the same virtual address
+ * in the same pgdir works, because pp_ref goes up before page_remove.
+ *
+ * RETURNS:
+ *   0 on success
+ *   -E_NO_MEM, if page table or reverse mapping couldn't be allocated,
+ *   or pp_ref is at PP_REF_MAX
+ */
+int page_insert(pde_t *pgdir, struct Page *pp, void *va, int perm) {
+    pte_t *pte;
+
+    if (!(pte = pgdir_walk(pgdir, va, 1))) {
+        return -E_NO_MEM;
+    }
+    assert(!(*pte & PTE_PS));
+    if (page_incref(pp) < 0) {
+        return -E_NO_MEM;
+    }
+    // The new Rmap goes in before page_remove() takes the old one out:
+    // if pp is already mapped here the two are the same, either will do.
+    if (rmap_add(pp, pgdir, (uintptr_t) va) < 0) {
+        --pp->pp_ref;
+        return -E_NO_MEM;
+    }
+    if (*pte & PTE_P) {
+        page_remove(pgdir, va);
+    } else if (pte_swapped(*pte)) {
+        swap_drop(*pte);
+    }
+    *pte = page2pa(pp) | perm | PTE_P;
+    return 0;
+}
+
+/**
+ * Return the page mapped at virtual address 'va'.
+ * If pte_store is not zero, then we store in it the address
+ * of the pte for this page.  This is used by page_remove and
+ * can be used to verify page permissions for syscall arguments,
+ * but should not be used by most callers.
+ *
+ * Return NULL if there is no page mapped at va.
+ */
+struct Page *page_lookup(pde_t *pgdir, void *va, pte_t **pte_store) {
+    pte_t *pte = pgdir_walk(pgdir, va, 0);
+
+    if (!pte || !(*pte & PTE_P) || (*pte & PTE_PS)) {
+        return NULL;
+    }
+    if (pte_store) {
+        *pte_store = pte;
+    }
+    return pa2page(PTE_ADDR(*pte));
+}
+
+/**
+ * Unmaps the physical page at virtual address 'va'.
+ * If there is no physical page at that address, silently does nothing.
+ *
+ * Details:
+ *   - The ref count on the physical page should decrement.
+ *   - The physical page should be freed if the refcount reaches 0.
+ *   - The pg table entry corresponding to 'va' should be set to 0.
+ *     (if such a PTE exists)
+ *   - The TLB must be invalidated if you remove an entry from
+ *     the page table.
+ */
+void page_remove(pde_t *pgdir, void *va) {
+    struct Page *pp;
+    pte_t *pte;
+
+    if (!(pp = page_lookup(pgdir, va, &pte))) {
+        if ((pte = pgdir_walk(pgdir, va, 0)) && pte_swapped(*pte)) {
+            swap_drop(*pte);
+            *pte = 0;
+        }
+        return;
+    }
+    if (*pte & PTE_D) {
+        pp->pp_flags &= ~PP_ZEROFILL;
+    }
+    rmap_remove(pp, pgdir, (uintptr_t) va);
+    *pte = 0;
+    tlb_invalidate(pgdir, va);
+    page_decref(pp);
+}
+
+/**
+ * Invalidate a TLB entry, but only if the page tables being
+ * edited are the ones currently in use by the processor.
+ */
+void tlb_invalidate(pde_t *pgdir, void *va) {
+    if (rcr3() == PADDR(pgdir)) {
+        invlpg(va);
+    }
+}
+
+int page_insert_huge(pde_t *pgdir, struct Page *pp, void *va, int perm) {
+    pde_t *pde = &pgdir[PDX(va)];
+
+    assert(PGOFF(va) == 0 && PTX(va) == 0);
+    assert(!(*pde & PTE_P) || (*pde & PTE_PS));
+    if (page_incref(pp) < 0) {
+        return -E_NO_MEM;
+    }
+    if (rmap_add(pp, pgdir, (uintptr_t) va) < 0) {
+        --pp->pp_ref;
+        return -E_NO_MEM;
+    }
+    if (*pde & PTE_P) {
+        page_remove_huge(pgdir, va);
+    }
+    *pde = page2pa(pp) | perm | PTE_PS | PTE_P;
+    return 0;
+}
+
+void page_remove_huge(pde_t *pgdir, void *va) {
+    pde_t *pde = &pgdir[PDX(va)];
+    struct Page *pp;
+
+    if ((*pde & (PTE_P | PTE_PS)) != (PTE_P | PTE_PS)) {
+        return;
+    }
+    pp = pa2page(PTE_ADDR(*pde));
+    rmap_remove(pp, pgdir, (uintptr_t) va);
+    *pde = 0;
+    tlb_invalidate(pgdir, va);
+    if (--pp->pp_ref == 0) {
+        pages_free(pp, HUGE_ORDER);
+    }
+}
+
+pde_t *pgdir_create(void) {
+    struct Page *pp;
+    pde_t *pgdir;
+
+    if (!(pp = page_alloc(ALLOC_ZERO))) {
+        return NULL;
+    }
+    pp->pp_ref = 1;
+    pgdir = page2kva(pp);
+
+    memmove(&pgdir[PDX(UTOP)], &kern_pgdir[PDX(UTOP)],
+            (NPDENTRIES - PDX(UTOP)) * sizeof(pde_t));
+    pgdir[PDX(VPT)] = PADDR(pgdir) | PTE_W | PTE_P;
+    pgdir[PDX(UVPT)] = PADDR(pgdir) | PTE_U | PTE_P;
+    return pgdir;
+}
+
+void pgdir_free(pde_t *pgdir) {
+    struct Tlbbatch tb;
+    uint32_t pdeno;
+
+    if (rcr3() == PADDR(pgdir)) {
+        lcr3(PADDR(kern_pgdir));
+    }
+
+    tlb_batch_init(&tb, pgdir);
+    pt_unmap(pgdir, 0, UTOP, &tb);
+    for (pdeno = 0; pdeno < PDX(UTOP); ++pdeno) {
+        if (pgdir[pdeno] & PTE_P) {
+            tlb_batch_release(&tb, pa2page(PTE_ADDR(pgdir[pdeno])), 0);
+            pgdir[pdeno] = 0;
+        }
+    }
+    tlb_batch_flush(&tb);
+    page_decref(pa2page(PADDR(pgdir)));
+}
+
+
+/**
+ * Check that the buddy allocator hands out aligned, disjoint blocks,
+ * zeroes when asked to, and merges everything back together on free.
+ */
+static void check_page_alloc(void) {
+    size_t before[PAGE_MAXORDER + 1];
+    struct Page *pp0, *pp1, *pp2;
+    uint32_t *p;
+    int i;
+
+    for (i = 0; i <= PAGE_MAXORDER; ++i) {
+        before[i] = page_nfree(i);
+    }
+
+    assert((pp0 = pages_alloc(0, 0)));
+    assert((pp1 = pages_alloc(3, 0)));
+    assert((pp2 = pages_alloc(1, ALLOC_ZERO)));
+    assert(page2pa(pp1) % (PGSIZE << 3) == 0);
+    assert(page2pa(pp2) % (PGSIZE << 1) == 0);
+    assert(pp0 < pp1 || pp0 >= pp1 + 8);
+    assert(pp2 + 2 <= pp1 || pp2 >= pp1 + 8);
+    assert(pp0 < pp2 || pp0 >= pp2 + 2);
+    for (p = page2kva(pp2); p < (uint32_t*) page2kva(pp2 + 2); ++p) {
+        assert(*p == 0);
+    }
+    assert(!pages_alloc(PAGE_MAXORDER + 1, 0));
+
+    pages_free(pp2, 1);
+    pages_free(pp1, 3);
+    pages_free(pp0, 0);
+    for (i = 0; i <= PAGE_MAXORDER; ++i) {
+        assert(page_nfree(i) == before[i]);
+    }
+
+    cprintf("check_page_alloc() succeeded!\n");
+}
+
+/**
+ * Check that the magazine refills and drains in batches, at its
+ * watermarks.
+ */
+static void check_pagemag(void) {
+    struct Pagemag *pm = &thiscpu->cpu_pagemag;
+    struct Page *pp[PAGEMAG_SIZE];
+    size_t nfree0 = 0, nfree = 0;
+    uint32_t misses;
+    int i, n = pagemag_high + 1;
+
+    assert(pm->pm_count == 0);
+    for (i = 0; i <= PAGE_MAXORDER; ++i) {
+        nfree0 += page_nfree(i) << i;
+    }
+
+    // the first allocation refills, the rest of the batch hits
+    misses = pm->pm_alloc_misses;
+    for (i = 0; i < pagemag_low; ++i) {
+        assert((pp[i] = page_alloc(0)));
+    }
+    assert(pm->pm_alloc_misses == misses + 1);
+    assert(pm->pm_count == 0);
+    for (; i < n; ++i) {
+        assert((pp[i] = page_alloc(0)));
+    }
+
+    // freeing them all overflows the magazine exactly once
+    misses = pm->pm_free_misses;
+    for (i = 0; i < n; ++i) {
+        page_free(pp[i]);
+    }
+    assert(pm->pm_free_misses == misses + 1);
+    assert(pm->pm_count == pagemag_low);
+
+    // and draining it gives back every page
+    pagemag_drain(pm);
+    for (i = 0; i <= PAGE_MAXORDER; ++i) {
+        nfree += page_nfree(i) << i;
+    }
+    assert(nfree == nfree0);
+
+    cprintf("check_pagemag() succeeded!\n");
+}
+
+/**
+ * Check that colour-directed allocation hands out consecutive colours
+ * and that colour_drain() empties every per-colour list.
+ */
+static void check_colour(void) {
+    struct Page *pp[2 * PAGE_MAXCOLOURS];
+    uint32_t c, n = 2 * page_ncolours;
+
+    // round-robin, starting anywhere, gets every colour in turn
+    for (c = 0; c < n; ++c) {
+        assert((pp[c] = page_alloc_colour(c + 5, ALLOC_ZERO)));
+        assert(page_colour(pp[c]) == ((c + 5) & (page_ncolours - 1)));
+    }
+    for (c = 0; c < n; ++c) {
+        page_free(pp[c]);
+    }
+    colour_drain();
+    for (c = 0; c < PAGE_MAXCOLOURS; ++c) {
+        assert(colour_nfree[c] == 0 && LIST_EMPTY(&colour_free[c]));
+    }
+
+    cprintf("check_colour() succeeded! %u colours\n", page_ncolours);
+}
+
+/**
+ * Check page_insert, page_remove and friends on a fresh address space.
+ */
+static void check_page(void) {
+    struct Page *pp0, *pp1;
+    pde_t *pgdir;
+    pte_t *pte;
+    char *va = (char *) UTEXT;
+
+    assert((pgdir = pgdir_create()));
+    assert(pgdir[PDX(KERNBASE)] == kern_pgdir[PDX(KERNBASE)]);
+    assert(PTE_ADDR(pgdir[PDX(UVPT)]) == PADDR(pgdir));
+    assert(!page_lookup(pgdir, va, NULL));
+
+    assert((pp0 = page_alloc(0)));
+    assert((pp1 = page_alloc(0)));
+
+    // page_insert makes the page table it needs
+    assert(page_insert(pgdir, pp0, va, PTE_U | PTE_W) == 0);
+    assert(page_lookup(pgdir, va, &pte) == pp0 && pp0->pp_ref == 1);
+    assert(*pte == (page2pa(pp0) | PTE_U | PTE_W | PTE_P));
+    assert(pa2page(PTE_ADDR(pgdir[PDX(va)]))->pp_ref == 1);
+
+    // re-inserting the same page just changes its permissions
+    assert(page_insert(pgdir, pp0, va, PTE_U) == 0);
+    assert(pp0->pp_ref == 1 && !(*pte & PTE_W));
+
+    // mapping another page over it frees it
+    assert(page_insert(pgdir, pp1, va, PTE_U) == 0);
+    assert(pp0->pp_ref == 0 && pp1->pp_ref == 1);
+
+    // the reference count saturates rather than wrapping around
+    pp1->pp_ref = PP_REF_MAX;
+    assert(page_insert(pgdir, pp1, va + PGSIZE, PTE_U) == -E_NO_MEM);
+    assert(!page_lookup(pgdir, va + PGSIZE, NULL));
+    pp1->pp_ref = 1;
+
+    page_remove(pgdir, va);
+    assert(!page_lookup(pgdir, va, NULL) && pp1->pp_ref == 0);
+    pgdir_free(pgdir);
+
+    cprintf("check_page() succeeded!\n");
+}
+
+
+/**
+ * TLB microbenchmark.  A context switch reloads %cr3 and then the kernel
+ * touches its text, data and stack; model that with one access in each
+ * of a few different 4MB kernel pages, so each needs its own TLB entry.
+ */
+
+#define BENCH_ROUNDS    1000
+#define BENCH_MAXPAGES  16
+
+static uint64_t switch_cycles(int npages) {
+    uint64_t start;
+    int r, i;
+
+    start = read_tsc();
+    for (r = 0; r < BENCH_ROUNDS; ++r) {
+        tlbflush();
+        for (i = 0; i < npages; ++i) {
+            (void) *(volatile uint32_t*) (KERNBASE + i * PTSIZE);
+        }
+    }
+    return (read_tsc() - start) / BENCH_ROUNDS;
+}
+
+void tlb_bench(void) {
+    uint64_t global, local;
+    int npages;
+
+    if (!pte_global) {
+        cprintf("tlb: no global pages on this CPU\n");
+        return;
+    }
+
+    // only touch 4MB pages that are backed by RAM
+    npages = MIN(memmap_npages() / NPTENTRIES, (uint32_t) BENCH_MAXPAGES);
+    npages = MAX(npages, 1);
+
+    switch_cycles(npages);  // warm up
+    global = switch_cycles(npages);
+    lcr4(rcr4() & ~CR4_PGE);
+    local = switch_cycles(npages);
+    lcr4(rcr4() | CR4_PGE);
+
+    cprintf("tlb: switch + %d kernel pages: %llu cycles global, %llu not\n",
+            npages, global, local);
+}
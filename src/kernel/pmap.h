@@ -0,0 +1,256 @@
+#ifndef _POTATOS_KERNEL_PMAP_H_
+#define _POTATOS_KERNEL_PMAP_H_
+#ifndef POS_KERNEL
+#error "This is a PotatOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/memlayout.h>
+#include <inc/assert.h>
+
+extern char bootstacktop[], bootstack[];
+
+extern struct Page *pages;
+extern size_t npages;
+extern size_t npages_low;
+
+extern pde_t *kern_pgdir;
+
+/**
+ * PTE_G if the CPU has global pages (entry.S checks, and turns CR4_PGE
+ * on), 0 if not.  Every mapping at or above UTOP is the same in all
+ * address spaces and should be built with it, so that switching
+ * address spaces leaves those TLB entries alone.  Changing one of those
+ * mappings then takes tlbflush_all() rather than tlbflush().
+ */
+extern pte_t pte_global;
+
+/**
+ * This macro takes a kernel virtual address -- an address that points
+ * above KERNBASE, where the first 256MB of physical memory are mapped --
+ * and returns the corresponding physical address.  It
+ * panics if you pass it a non-kernel virtual address.
+ */
+#define PADDR(kva) _paddr(__FILE__, __LINE__, kva)
+
+static inline physaddr_t _paddr(const char *file, int line, void *kva) {
+    if ((uint32_t) kva < KERNBASE) {
+        _panic(file, line, "PADDR called with invalid kva %08x", kva);
+    }
+    return (physaddr_t) kva - KERNBASE;
+}
+
+/**
+ * This macro takes a physical address and returns the corresponding
+ * kernel virtual address.  It panics if you pass an invalid physical
+ * address, or one beyond the direct map: high memory has to be kmap()ed.
+ */
+#define KADDR(pa) _kaddr(__FILE__, __LINE__, pa)
+
+static inline void* _kaddr(const char *file, int line, physaddr_t pa) {
+    if (PPN(pa) >= npages_low) {
+        _panic(file, line, "KADDR called with invalid pa %08x", pa);
+    }
+    return (void*) (pa + KERNBASE);
+}
+
+// Largest block the page allocator hands out: 2^PAGE_MAXORDER pages, or
+// one 4MB large page.
+#define PAGE_MAXORDER   10
+
+// Order of the block behind one 4MB page
+#define HUGE_ORDER      (PTSHIFT - PGSHIFT)
+
+enum {
+    // For page_alloc, zero the returned physical page.
+    ALLOC_ZERO = 1 << 0,
+    // Prefer a high memory page, which has no kernel address: only for
+    // pages that are only ever mapped into user space, or kmap()ed.
+    ALLOC_HIGH = 1 << 1,
+};
+
+void mem_init(void);
+
+void page_init(void);
+struct Page *page_alloc(int alloc_flags);
+void page_free(struct Page *pp);
+int page_incref(struct Page *pp);
+void page_decref(struct Page *pp);
+
+int page_insert(pde_t *pgdir, struct Page *pp, void *va, int perm);
+void page_remove(pde_t *pgdir, void *va);
+struct Page *page_lookup(pde_t *pgdir, void *va, pte_t **pte_store);
+pte_t *pgdir_walk(pde_t *pgdir, const void *va, int create);
+void tlb_invalidate(pde_t *pgdir, void *va);
+
+/**
+ * Map a 2^HUGE_ORDER block of pages as one 4MB page (PTE_PS) at va,
+ * replacing any 4MB page there.  As with page_insert, pp->pp_ref (of the
+ * block's first page) counts the mappings.
+ * @param va  4MB aligned, with no page table behind it
+ * @return  0, or -E_NO_MEM if pp_ref is at PP_REF_MAX or the reverse
+ *          mapping could not be allocated
+ */
+int page_insert_huge(pde_t *pgdir, struct Page *pp, void *va, int perm);
+
+/**
+ * Unmap the 4MB page at va, if there is one, freeing its block on the
+ * last reference.
+ */
+void page_remove_huge(pde_t *pgdir, void *va);
+
+/**
+ * Make a page directory for a new address space: nothing mapped below
+ * UTOP, the kernel's mappings above, and its own page tables at VPT and
+ * UVPT.
+ * @return  the page directory's kernel virtual address, or NULL if out
+ *          of memory
+ */
+pde_t *pgdir_create(void);
+
+/**
+ * Tear down an address space: unmap everything below UTOP, then free its
+ * page tables and the page directory itself.  Switches to kern_pgdir
+ * first if pgdir is the current one.
+ */
+void pgdir_free(pde_t *pgdir);
+
+// Higher-order blocks, straight from the buddy allocator
+
+/**
+ * Allocate 2^order physically contiguous pages, aligned to their size.
+ * @param order        0 to PAGE_MAXORDER
+ * @param alloc_flags  ALLOC_*; with ALLOC_HIGH, from high memory if it
+ *                     has such a block free
+ * @return  the first Page of the block, or NULL if no block is free.
+ *          pp_ref of every page in it is zero.
+ */
+struct Page *pages_alloc(int order, int alloc_flags);
+
+/**
+ * Return a block from pages_alloc to the free pool, merging it with its
+ * free buddies.
+ * @param pp     first Page of the block; its pp_ref must be zero
+ * @param order  the order it was allocated with
+ */
+void pages_free(struct Page *pp, int order);
+
+/**
+ * @return  number of free blocks of 2^order pages
+ */
+size_t page_nfree(int order);
+
+/**
+ * @return  number of free high memory pages
+ */
+size_t page_nfree_high(void);
+
+/**
+ * Per-CPU page magazines.  page_alloc() and page_free() work on a stack
+ * of free pages private to the current CPU, so the common case takes no
+ * lock and touches no shared cache line.  Only when a magazine runs
+ * empty, or overflows, do they go to the buddy allocator, under its
+ * lock, and then for a batch of pages at once:
+ *  - an empty magazine is refilled with pagemag_low pages;
+ *  - a magazine holding more than pagemag_high pages is drained back
+ *    down to pagemag_low.
+ * The kernel runs with interrupts off, so nothing else ever touches a
+ * CPU's magazine while it does.
+ */
+#define PAGEMAG_SIZE    256
+
+struct Pagemag {
+    struct Page *pm_pages[PAGEMAG_SIZE];
+    int pm_count;
+    uint32_t pm_alloc_hits;     // page_alloc()s served from the magazine
+    uint32_t pm_alloc_misses;   // ... that had to refill it first
+    uint32_t pm_free_hits;      // page_free()s kept in the magazine
+    uint32_t pm_free_misses;    // ... that made it drain
+};
+
+extern int pagemag_low, pagemag_high;
+
+/**
+ * Set the magazine watermarks, and drain the current CPU's magazine.
+ * @return  0, or -1 unless 0 < low <= high < PAGEMAG_SIZE
+ */
+int pagemag_tune(int low, int high);
+
+/**
+ * Give every page in a magazine back to the buddy allocator.
+ */
+void pagemag_drain(struct Pagemag *pm);
+
+/**
+ * Page colouring: see pmap.c.  page_ncolours is how many pages make up
+ * one way of the L2 cache, a power of two; 1 if cpuid did not say, or
+ * colouring could not help.  With page_colouring on, vm_fault() hands
+ * each address space its pages in colour order.
+ */
+#define PAGE_MAXCOLOURS     64
+#define COLOUR_BUCKET_MAX   4   // free pages kept per colour
+
+struct Colour_stats {
+    uint32_t cs_allocs;         // pages handed out in the colour asked for
+    uint32_t cs_refills;        // blocks split up to refill a bucket
+    uint32_t cs_fallbacks;      // pages of whatever colour, memory being short
+};
+
+extern uint32_t page_ncolours;
+extern uint32_t page_cache_ways, page_cache_line;   // L2 geometry
+extern bool page_colouring;
+extern struct Colour_stats colour_stats;
+
+void colour_init(void);
+
+/**
+ * Allocate a page of colour (colour mod page_ncolours), or of any
+ * colour if there is no block left to split.  Whatever alloc_flags say,
+ * the page may be high memory: coloured pages are for user space.
+ * @param alloc_flags  ALLOC_*
+ */
+struct Page *page_alloc_colour(int colour, int alloc_flags);
+
+/**
+ * @return  how many free pages are kept for page_alloc_colour()
+ */
+size_t colour_nfree_total(void);
+
+/**
+ * Give the free pages kept for page_alloc_colour() back to the buddy
+ * allocator.
+ */
+void colour_drain(void);
+
+/**
+ * Time an address space switch followed by a few kernel accesses, with
+ * and without global pages, and print the result.  It runs thousands of
+ * rounds, so it is the monitor's tlbbench command rather than part of
+ * boot.
+ */
+void tlb_bench(void);
+
+static inline physaddr_t page2pa(struct Page *pp) {
+    return (pp - pages) << PGSHIFT;
+}
+
+static inline struct Page* pa2page(physaddr_t pa) {
+    if (PPN(pa) >= npages) {
+        panic("pa2page called with invalid pa");
+    }
+    return &pages[PPN(pa)];
+}
+
+static inline void* page2kva(struct Page *pp) {
+    return KADDR(page2pa(pp));
+}
+
+static inline uint32_t page_colour(struct Page *pp) {
+    return (pp - pages) & (page_ncolours - 1);
+}
+
+// Whether pp is beyond the direct map, so that page2kva() won't do
+static inline bool page_is_high(struct Page *pp) {
+    return (size_t) (pp - pages) >= npages_low;
+}
+
+#endif  // !_POTATOS_KERNEL_PMAP_H_
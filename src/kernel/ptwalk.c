@@ -0,0 +1,234 @@
+#include <inc/x86.h>
+#include <inc/mmu.h>
+#include <inc/error.h>
+#include <inc/stdio.h>
+#include <inc/assert.h>
+
+#include <kernel/ptwalk.h>
+#include <kernel/pmap.h>
+#include <kernel/tlb.h>
+#include <kernel/rmap.h>
+#include <kernel/swap.h>
+
+static void check_ptwalk(void);
+
+int pt_walk(pde_t *pgdir, uintptr_t start, uintptr_t end, pt_walk_fn fn,
+            void *arg) {
+    bool current = rcr3() == PADDR(pgdir);
+    pde_t *pd = current ? (pde_t *) vpd : pgdir;
+    uintptr_t va = start, next;
+    pte_t *pt;
+    int r;
+
+    assert(PGOFF(start) == 0 && PGOFF(end) == 0 && end <= UTOP);
+
+    while (va < end) {
+        next = MIN(ROUNDDOWN(va, PTSIZE) + PTSIZE, end);
+        if (!(pd[PDX(va)] & PTE_P)) {
+            va = next;
+            continue;
+        }
+
+        if (pd[PDX(va)] & PTE_PS) {
+            if ((r = fn(ROUNDDOWN(va, PTSIZE), &pd[PDX(va)], arg)) < 0) {
+                return r;
+            }
+            va = next;
+            continue;
+        }
+
+        if (current) {
+            pt = (pte_t *) &vpt[VPN(ROUNDDOWN(va, PTSIZE))];
+        } else {
+            pt = KADDR(PTE_ADDR(pd[PDX(va)]));
+        }
+        for (; va < next; va += PGSIZE) {
+            if (((pt[PTX(va)] & PTE_P) || pte_swapped(pt[PTX(va)])) &&
+                (r = fn(va, &pt[PTX(va)], arg)) < 0) {
+                return r;
+            }
+        }
+    }
+    return 0;
+}
+
+// Per-walk state for pt_unmap and pt_protect
+struct walk_arg {
+    uintptr_t wa_end;
+    int wa_perm;
+    struct Tlbbatch *wa_tb;
+};
+
+static int unmap_one(uintptr_t va, pte_t *pte, void *arg) {
+    struct walk_arg *wa = arg;
+    struct Page *pp;
+
+    if (pte_swapped(*pte)) {
+        swap_drop(*pte);
+        *pte = 0;
+        return 0;
+    }
+
+    pp = pa2page(PTE_ADDR(*pte));
+    if (*pte & PTE_D) {
+        pp->pp_flags &= ~PP_ZEROFILL;
+    }
+    rmap_remove(pp, wa->wa_tb->tb_pgdir, va);
+    if (*pte & PTE_PS) {
+        assert(va + PTSIZE <= wa->wa_end);
+        tlb_batch_release(wa->wa_tb, pp, HUGE_ORDER);
+    } else {
+        tlb_batch_release(wa->wa_tb, pp, 0);
+    }
+    *pte = 0;
+    // a 4MB page is one TLB entry, which any address in it invalidates
+    tlb_batch_add(wa->wa_tb, va, PGSIZE);
+    return 0;
+}
+
+void pt_unmap(pde_t *pgdir, uintptr_t start, uintptr_t end,
+              struct Tlbbatch *tb) {
+    struct walk_arg wa = { end, 0, tb };
+
+    if (start < end) {
+        assert(start % PTSIZE == 0 || !(pgdir[PDX(start)] & PTE_PS));
+    }
+    pt_walk(pgdir, start, end, unmap_one, &wa);
+}
+
+static int clear_one(uintptr_t va, pte_t *pte, void *arg) {
+    struct walk_arg *wa = arg;
+
+    assert(!(*pte & PTE_PS));
+    *pte = 0;
+    tlb_batch_add(wa->wa_tb, va, PGSIZE);
+    return 0;
+}
+
+void pt_unmap_uncounted(pde_t *pgdir, uintptr_t start, uintptr_t end,
+                        struct Tlbbatch *tb) {
+    struct walk_arg wa = { end, 0, tb };
+
+    pt_walk(pgdir, start, end, clear_one, &wa);
+}
+
+// Whether another mapping holds pte's page too.  pt_map()'s device
+// memory has no struct Page, and no one to share it with.
+static bool pte_shared(pte_t pte) {
+    return PPN(pte) < npages && pa2page(PTE_ADDR(pte))->pp_ref > 1;
+}
+
+static int protect_one(uintptr_t va, pte_t *pte, void *arg) {
+    struct walk_arg *wa = arg;
+    pte_t new = *pte & ~PTE_W;
+
+    // a swap entry takes the region's permissions when it is read back
+    if (!(*pte & PTE_P)) {
+        return 0;
+    }
+    // A page shared read-only, as cow_copy() shares one, becomes
+    // copy-on-write, so that the write fault gives the writer its own.
+    if ((wa->wa_perm & PTE_W) && !(*pte & PTE_COW)) {
+        new |= pte_shared(*pte) ? PTE_COW : PTE_W;
+    }
+    if (new != *pte) {
+        *pte = new;
+        tlb_batch_add(wa->wa_tb, va, PGSIZE);
+    }
+    return 0;
+}
+
+void pt_protect(pde_t *pgdir, uintptr_t start, uintptr_t end, int perm,
+                struct Tlbbatch *tb) {
+    struct walk_arg wa = { end, perm, tb };
+
+    pt_walk(pgdir, start, end, protect_one, &wa);
+}
+
+int pt_map(pde_t *pgdir, uintptr_t va, size_t len, physaddr_t pa, int perm) {
+    pte_t *pte;
+    size_t off;
+
+    assert(PGOFF(va) == 0 && PGOFF(len) == 0 && PGOFF(pa) == 0);
+    for (off = 0; off < len; off += PGSIZE) {
+        if (!(pte = pgdir_walk(pgdir, (void *) (va + off), 1))) {
+            return -E_NO_MEM;
+        }
+        assert(!(*pte & PTE_PS));
+        *pte = (pa + off) | perm | PTE_P;
+    }
+    return 0;
+}
+
+void ptwalk_init(void) {
+    check_ptwalk();
+}
+
+static int count_one(uintptr_t va, pte_t *pte, void *arg) {
+    ++*(int *) arg;
+    return 0;
+}
+
+static int stop_one(uintptr_t va, pte_t *pte, void *arg) {
+    return va == (uintptr_t) arg ? -E_INVAL : 0;
+}
+
+/**
+ * Check that walks find exactly what is mapped, through the current or
+ * another page directory, and that the operations built on them work.
+ */
+static void check_ptwalk(void) {
+    struct Tlbbatch tb;
+    struct Page *pp;
+    pde_t *pgdir;
+    uintptr_t va[] = { UTEXT, UTEXT + PGSIZE, UTEXT + 7 * PTSIZE,
+                       USTACKTOP - PGSIZE };
+    pte_t *pte;
+    int i, n;
+
+    assert((pgdir = pgdir_create()));
+    for (i = 0; i < sizeof(va) / sizeof(va[0]); ++i) {
+        assert((pp = page_alloc(0)));
+        assert(page_insert(pgdir, pp, (void *) va[i], PTE_U | PTE_W) == 0);
+    }
+
+    n = 0;
+    assert(pt_walk(pgdir, 0, UTOP, count_one, &n) == 0 && n == 4);
+    n = 0;
+    assert(pt_walk(pgdir, UTEXT + PGSIZE, USTACKTOP, count_one, &n) == 0);
+    assert(n == 2);
+    assert(pt_walk(pgdir, 0, UTOP, stop_one, (void *) va[2]) == -E_INVAL);
+
+    // the same through vpt[]
+    lcr3(PADDR(pgdir));
+    n = 0;
+    assert(pt_walk(pgdir, 0, UTOP, count_one, &n) == 0 && n == 4);
+
+    tlb_batch_init(&tb, pgdir);
+    pt_protect(pgdir, 0, UTOP, PTE_U, &tb);
+    tlb_batch_flush(&tb);
+    for (i = 0; i < sizeof(va) / sizeof(va[0]); ++i) {
+        assert(page_lookup(pgdir, (void *) va[i], &pte));
+        assert(!(*pte & PTE_W));
+    }
+
+    pt_unmap(pgdir, UTEXT, UTEXT + PTSIZE, &tb);
+    tlb_batch_flush(&tb);
+    n = 0;
+    assert(pt_walk(pgdir, 0, UTOP, count_one, &n) == 0 && n == 2);
+    lcr3(PADDR(kern_pgdir));
+
+    // device-style mappings leave pp_ref alone
+    pp = pa2page(PTE_ADDR(*pgdir_walk(pgdir, (void *) va[3], 0)));
+    assert(pt_map(pgdir, UTEXT, 2 * PGSIZE, page2pa(pp), PTE_U) == 0);
+    assert(page_lookup(pgdir, (void *) (UTEXT + PGSIZE), NULL) == pp + 1);
+    assert(pp->pp_ref == 1);
+    tlb_batch_init(&tb, pgdir);
+    pt_unmap_uncounted(pgdir, UTEXT, UTEXT + 2 * PGSIZE, &tb);
+    tlb_batch_flush(&tb);
+    assert(!page_lookup(pgdir, (void *) UTEXT, NULL));
+    assert(pp->pp_ref == 1);
+
+    pgdir_free(pgdir);
+    cprintf("check_ptwalk() succeeded!\n");
+}
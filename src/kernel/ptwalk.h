@@ -0,0 +1,79 @@
+#ifndef _POTATOS_KERNEL_PTWALK_H_
+#define _POTATOS_KERNEL_PTWALK_H_
+#ifndef POS_KERNEL
+#error "This is a PotatOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/memlayout.h>
+
+struct Tlbbatch;
+
+/**
+ * Page table range walks.  pt_walk() visits the present mappings and
+ * swap entries in a range of user address space, skipping 4MB at a time wherever there is
+ * no page table, so its cost follows what is mapped rather than how big
+ * the range is.  When the page directory is the current one it reads
+ * the page tables through vpd[] and vpt[]; otherwise through KADDR().
+ *
+ * pt_unmap(), pt_protect(), pt_map() and pt_unmap_uncounted() are
+ * built on it, and so is cow_copy().
+ */
+
+/**
+ * Check the walker.  Needs the page allocator and kern_pgdir.
+ */
+void ptwalk_init(void);
+
+/**
+ * Called for each present mapping or swap entry.
+ * @param va   the page's address; for a 4MB page, its 4MB-aligned start
+ * @param pte  its entry, which may be changed; PTE_PS for a 4MB page,
+ *             and not PTE_P for a swap entry
+ * @return  0 to carry on, or a negative error to stop the walk with
+ */
+typedef int (*pt_walk_fn)(uintptr_t va, pte_t *pte, void *arg);
+
+/**
+ * Visit every present mapping and swap entry in [start, end).
+ * @param start, end  page aligned, end at most UTOP
+ * @return  0, or the first negative value fn returned
+ */
+int pt_walk(pde_t *pgdir, uintptr_t start, uintptr_t end, pt_walk_fn fn,
+            void *arg);
+
+/**
+ * Unmap everything in [start, end).  The TLB invalidations and the page
+ * releases are queued in tb; the caller does tlb_batch_flush() when
+ * done.  A 4MB page in the range must be entirely inside it.
+ */
+void pt_unmap(pde_t *pgdir, uintptr_t start, uintptr_t end,
+              struct Tlbbatch *tb);
+
+/**
+ * Change the PTE_W permission of everything mapped in [start, end) to
+ * that in perm, queueing the invalidations in tb.  A PTE_COW page stays
+ * read-only, and a page that other mappings share becomes PTE_COW
+ * rather than writable; the write fault makes it writable.
+ */
+void pt_protect(pde_t *pgdir, uintptr_t start, uintptr_t end, int perm,
+                struct Tlbbatch *tb);
+
+/**
+ * Map [va, va + len) to physical [pa, pa + len) with perm, making page
+ * tables as needed.  Does not touch any pp_ref: it is for memory the
+ * page allocator does not hand out, such as device memory.  Take the
+ * range down with pt_unmap_uncounted(), before any pt_unmap() or
+ * pgdir_free() covers it: those drop a reference per page.
+ * @return  0, or -E_NO_MEM if a page table could not be allocated
+ */
+int pt_map(pde_t *pgdir, uintptr_t va, size_t len, physaddr_t pa, int perm);
+
+/**
+ * Unmap pt_map()'s mappings in [start, end), queueing the invalidations
+ * in tb.  Releases no page.
+ */
+void pt_unmap_uncounted(pde_t *pgdir, uintptr_t start, uintptr_t end,
+                        struct Tlbbatch *tb);
+
+#endif  // !_POTATOS_KERNEL_PTWALK_H_
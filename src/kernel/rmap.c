@@ -0,0 +1,117 @@
+#include <inc/mmu.h>
+#include <inc/error.h>
+#include <inc/stdio.h>
+#include <inc/assert.h>
+
+#include <kernel/rmap.h>
+#include <kernel/pmap.h>
+#include <kernel/slab.h>
+
+struct Rmap_stats rmap_stats;
+
+static struct kmem_cache *rmap_cache;
+
+static void check_rmap(void);
+
+void rmap_init(void) {
+    if (!(rmap_cache = kmem_cache_create("rmap", sizeof(struct Rmap), 0,
+                                         NULL))) {
+        panic("rmap_init: out of memory");
+    }
+    check_rmap();
+}
+
+int rmap_add(struct Page *pp, pde_t *pgdir, uintptr_t va) {
+    struct Rmap *rm;
+
+    if (!(rm = kmem_cache_alloc(rmap_cache))) {
+        return -E_NO_MEM;
+    }
+    rm->rm_pgdir = pgdir;
+    rm->rm_va = va;
+    rm->rm_next = pp->pp_rmap;
+    pp->pp_rmap = rm;
+    ++rmap_stats.rs_live;
+    return 0;
+}
+
+void rmap_remove(struct Page *pp, pde_t *pgdir, uintptr_t va) {
+    struct Rmap **prev, *rm;
+
+    for (prev = &pp->pp_rmap; (rm = *prev) != NULL; prev = &rm->rm_next) {
+        if (rm->rm_pgdir == pgdir && rm->rm_va == va) {
+            *prev = rm->rm_next;
+            kmem_cache_free(rmap_cache, rm);
+            --rmap_stats.rs_live;
+            return;
+        }
+    }
+    panic("rmap_remove: page %08x not mapped at %08x", page2pa(pp), va);
+}
+
+int rmap_count(struct Page *pp) {
+    struct Rmap *rm;
+    int n = 0;
+
+    for (rm = pp->pp_rmap; rm; rm = rm->rm_next) {
+        ++n;
+    }
+    return n;
+}
+
+int page_unmap_all(struct Page *pp) {
+    struct Rmap *rm;
+    int n = 0;
+
+    ++rmap_stats.rs_unmap_all;
+    // each removal takes the head of the chain off, and the last one
+    // may free pp, which leaves the chain empty
+    while ((rm = pp->pp_rmap) != NULL) {
+        if (rm->rm_pgdir[PDX(rm->rm_va)] & PTE_PS) {
+            page_remove_huge(rm->rm_pgdir, (void *) rm->rm_va);
+        } else {
+            page_remove(rm->rm_pgdir, (void *) rm->rm_va);
+        }
+        ++n;
+    }
+    return n;
+}
+
+static void check_rmap(void) {
+    struct Page *pp, *other;
+    pde_t *pgdir1, *pgdir2;
+    char *va = (char *) UTEXT;
+
+    assert((pgdir1 = pgdir_create()));
+    assert((pgdir2 = pgdir_create()));
+    assert((pp = page_alloc(0)));
+    assert((other = page_alloc(0)));
+
+    assert(page_insert(pgdir1, pp, va, PTE_U) == 0);
+    assert(page_insert(pgdir1, pp, va + PGSIZE, PTE_U) == 0);
+    assert(page_insert(pgdir2, pp, va, PTE_U | PTE_W) == 0);
+    assert(page_insert(pgdir2, other, va + PGSIZE, PTE_U) == 0);
+    assert(rmap_count(pp) == 3 && rmap_count(other) == 1);
+
+    // re-inserting at the same place leaves one mapping
+    assert(page_insert(pgdir2, pp, va, PTE_U) == 0);
+    assert(rmap_count(pp) == 3 && pp->pp_ref == 3);
+
+    // replacing a mapping moves it to the new page
+    assert(page_insert(pgdir1, other, va + PGSIZE, PTE_U) == 0);
+    assert(rmap_count(pp) == 2 && rmap_count(other) == 2);
+
+    // unmap everywhere, keeping pp alive to look at
+    ++pp->pp_ref;
+    assert(page_unmap_all(pp) == 2);
+    assert(pp->pp_ref == 1 && !pp->pp_rmap);
+    assert(!page_lookup(pgdir1, va, NULL) && !page_lookup(pgdir2, va, NULL));
+    assert(page_lookup(pgdir1, va + PGSIZE, NULL) == other);
+    page_decref(pp);
+
+    pgdir_free(pgdir2);
+    assert(rmap_count(other) == 1);
+    pgdir_free(pgdir1);
+    assert(!other->pp_rmap);
+    cprintf("check_rmap() succeeded!\n");
+}
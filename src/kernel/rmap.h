@@ -0,0 +1,65 @@
+#ifndef _POTATOS_KERNEL_RMAP_H_
+#define _POTATOS_KERNEL_RMAP_H_
+#ifndef POS_KERNEL
+#error "This is a PotatOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/memlayout.h>
+
+/**
+ * Reverse mappings.  Every mapping that holds a reference on a page --
+ * what page_insert() and page_insert_huge() make -- also puts a
+ * struct Rmap on the page's pp_rmap chain, naming the page directory
+ * and address it is mapped at, so the page's mappings can be found
+ * without searching every address space.  A 4MB page's mappings are on
+ * the chain of its block's first page.
+ *
+ * pt_map()'s device-style mappings hold no reference, and have no
+ * Rmap either.
+ */
+struct Rmap {
+    pde_t *rm_pgdir;
+    uintptr_t rm_va;
+    struct Rmap *rm_next;
+};
+
+struct Rmap_stats {
+    uint32_t rs_live;           // Rmaps in use
+    uint32_t rs_unmap_all;      // pages page_unmap_all()ed
+};
+
+extern struct Rmap_stats rmap_stats;
+
+/**
+ * Set up the Rmap cache.  Needs kmem_init(), and has to come before the
+ * first page_insert().
+ */
+void rmap_init(void);
+
+/**
+ * Record that pp is mapped at va in pgdir.
+ * @return  0, or -E_NO_MEM
+ */
+int rmap_add(struct Page *pp, pde_t *pgdir, uintptr_t va);
+
+/**
+ * Forget that pp is mapped at va in pgdir, which it must be.
+ */
+void rmap_remove(struct Page *pp, pde_t *pgdir, uintptr_t va);
+
+/**
+ * @return  how many mappings pp has
+ */
+int rmap_count(struct Page *pp);
+
+/**
+ * Unmap pp from every address space that maps it, dropping the
+ * references those mappings hold, which may free it.  Costs one step per
+ * mapping, however big the address spaces are.
+ * @param pp  a page, or the first page of a 4MB page's block
+ * @return  how many mappings there were
+ */
+int page_unmap_all(struct Page *pp);
+
+#endif  // !_POTATOS_KERNEL_RMAP_H_
@@ -0,0 +1,458 @@
+#include <inc/stdio.h>
+#include <inc/string.h>
+#include <inc/assert.h>
+
+#include <kernel/slab.h>
+#include <kernel/pmap.h>
+
+// The cache kmem_cache structs themselves come from
+static struct kmem_cache kmem_cache_cache;
+
+// All caches, for kmem_print()
+static LIST_HEAD(, kmem_cache) kmem_caches;
+static struct spinlock kmem_lock;
+
+// kmalloc() size classes: KMALLOC_MIN << i
+#define KMALLOC_NCLASSES    8
+_Static_assert(KMALLOC_MIN << (KMALLOC_NCLASSES - 1) == KMALLOC_MAX,
+               "kmalloc size classes do not reach KMALLOC_MAX");
+
+static struct kmem_cache *kmalloc_caches[KMALLOC_NCLASSES];
+static const char *kmalloc_names[KMALLOC_NCLASSES] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+    "kmalloc-256", "kmalloc-512", "kmalloc-1024", "kmalloc-2048",
+};
+
+static void check_kmem(void);
+
+static size_t colour_step(struct kmem_cache *kc) {
+    return MAX(kc->kc_align, (size_t) KMEM_CACHELINE);
+}
+
+/**
+ * Fill in a cache, and pick its slab size: the smallest that wastes no
+ * more than an eighth of itself.  What is left over becomes colour.
+ */
+static void cache_setup(struct kmem_cache *kc, const char *name,
+                        size_t size, size_t align, void (*ctor)(void *)) {
+    size_t slabsize, left;
+    int n;
+
+    if (align == 0) {
+        align = sizeof(void *);
+    }
+    assert((align & (align - 1)) == 0);
+
+    memset(kc, 0, sizeof(*kc));
+    kc->kc_name = name;
+    kc->kc_align = align;
+    kc->kc_size = ROUNDUP(size, align);
+    kc->kc_ctor = ctor;
+
+    for (kc->kc_order = 0; ; ++kc->kc_order) {
+        slabsize = PGSIZE << kc->kc_order;
+        n = (slabsize - sizeof(struct Slab)) /
+            (kc->kc_size + sizeof(uint16_t));
+        n = MIN(n, KMEM_BUFCTL_END);
+        while (n > 0 && ROUNDUP(sizeof(struct Slab) + n * sizeof(uint16_t),
+                                align) + n * kc->kc_size > slabsize) {
+            --n;
+        }
+        kc->kc_nobjs = n;
+        kc->kc_offset = ROUNDUP(sizeof(struct Slab) + n * sizeof(uint16_t),
+                                align);
+        left = slabsize - kc->kc_offset - n * kc->kc_size;
+        if ((n > 0 && left * 8 <= slabsize) ||
+            kc->kc_order == KMEM_MAXORDER) {
+            break;
+        }
+    }
+    assert(kc->kc_nobjs > 0);
+    kc->kc_ncolours = left / colour_step(kc) + 1;
+
+    spin_initlock(&kc->kc_lock);
+    LIST_INIT(&kc->kc_partial);
+    LIST_INIT(&kc->kc_full);
+    LIST_INIT(&kc->kc_empty);
+
+    spin_lock(&kmem_lock);
+    LIST_INSERT_HEAD(&kmem_caches, kc, kc_link);
+    spin_unlock(&kmem_lock);
+}
+
+/**
+ * Make a new slab, with every object constructed and free.  Caller
+ * holds kc_lock.
+ */
+static struct Slab *slab_create(struct kmem_cache *kc) {
+    struct Page *pp;
+    struct Slab *slab;
+    int i;
+
+    if (kc->kc_order == 0) {
+        pp = page_alloc(0);
+    } else {
+        pp = pages_alloc(kc->kc_order, 0);
+    }
+    if (!pp) {
+        return NULL;
+    }
+
+    slab = page2kva(pp);
+    for (i = 0; i < (1 << kc->kc_order); ++i) {
+        pp[i].pp_flags |= PP_SLAB;
+        pp[i].pp_slab = slab;
+    }
+
+    slab->s_cache = kc;
+    slab->s_mem = (char *) slab + kc->kc_offset +
+                  kc->kc_colour * colour_step(kc);
+    kc->kc_colour = (kc->kc_colour + 1) % kc->kc_ncolours;
+    slab->s_inuse = 0;
+    slab->s_free = 0;
+    for (i = 0; i < kc->kc_nobjs; ++i) {
+        slab->s_bufctl[i] = i + 1;
+        if (kc->kc_ctor) {
+            kc->kc_ctor(slab->s_mem + i * kc->kc_size);
+        }
+    }
+    slab->s_bufctl[kc->kc_nobjs - 1] = KMEM_BUFCTL_END;
+
+    ++kc->kc_nslabs;
+    return slab;
+}
+
+// Give a slab back to the page allocator.  Caller holds kc_lock.
+static void slab_destroy(struct kmem_cache *kc, struct Slab *slab) {
+    struct Page *pp = pa2page(PADDR(slab));
+    int i;
+
+    assert(slab->s_inuse == 0);
+    for (i = 0; i < (1 << kc->kc_order); ++i) {
+        pp[i].pp_flags &= ~PP_SLAB;
+        pp[i].pp_slab = NULL;
+    }
+
+    if (kc->kc_order == 0) {
+        page_free(pp);
+    } else {
+        pages_free(pp, kc->kc_order);
+    }
+    --kc->kc_nslabs;
+}
+
+// Take an object out of the cache's slabs.  Caller holds kc_lock.
+static void *slab_get(struct kmem_cache *kc) {
+    struct Slab *slab;
+    void *obj;
+
+    if ((slab = LIST_FIRST(&kc->kc_partial)) == NULL) {
+        if ((slab = LIST_FIRST(&kc->kc_empty)) != NULL) {
+            LIST_REMOVE(slab, s_link);
+        } else if ((slab = slab_create(kc)) == NULL) {
+            return NULL;
+        }
+        LIST_INSERT_HEAD(&kc->kc_partial, slab, s_link);
+    }
+
+    obj = slab->s_mem + slab->s_free * kc->kc_size;
+    slab->s_free = slab->s_bufctl[slab->s_free];
+    ++slab->s_inuse;
+    if (slab->s_free == KMEM_BUFCTL_END) {
+        LIST_REMOVE(slab, s_link);
+        LIST_INSERT_HEAD(&kc->kc_full, slab, s_link);
+    }
+
+    ++kc->kc_inuse;
+    return obj;
+}
+
+/**
+ * Put an object back in its slab.  Keeps one empty slab around, to
+ * absorb a workload hovering around a slab boundary, and frees any
+ * others.  Caller holds kc_lock.
+ */
+static void slab_put(struct kmem_cache *kc, void *obj) {
+    struct Slab *slab = pa2page(PADDR(obj))->pp_slab;
+    uint32_t i = ((char *) obj - slab->s_mem) / kc->kc_size;
+
+    assert(slab && slab->s_cache == kc);
+    assert(slab->s_mem + i * kc->kc_size == obj && i < kc->kc_nobjs);
+
+    if (slab->s_free == KMEM_BUFCTL_END) {
+        LIST_REMOVE(slab, s_link);
+        LIST_INSERT_HEAD(&kc->kc_partial, slab, s_link);
+    }
+    slab->s_bufctl[i] = slab->s_free;
+    slab->s_free = i;
+    --slab->s_inuse;
+    --kc->kc_inuse;
+
+    if (slab->s_inuse == 0) {
+        LIST_REMOVE(slab, s_link);
+        if (LIST_EMPTY(&kc->kc_empty)) {
+            LIST_INSERT_HEAD(&kc->kc_empty, slab, s_link);
+        } else {
+            slab_destroy(kc, slab);
+        }
+    }
+}
+
+// Return every object in a per-CPU array to the slabs.
+static void cpu_flush(struct kmem_cache *kc, struct kmem_cpu *c) {
+    spin_lock(&kc->kc_lock);
+    while (c->kcc_count > 0) {
+        slab_put(kc, c->kcc_objs[--c->kcc_count]);
+    }
+    spin_unlock(&kc->kc_lock);
+}
+
+void kmem_init(void) {
+    int i;
+
+    spin_initlock(&kmem_lock);
+    LIST_INIT(&kmem_caches);
+    cache_setup(&kmem_cache_cache, "kmem_cache", sizeof(struct kmem_cache),
+                0, NULL);
+
+    for (i = 0; i < KMALLOC_NCLASSES; ++i) {
+        kmalloc_caches[i] = kmem_cache_create(kmalloc_names[i],
+                KMALLOC_MIN << i, MIN(KMALLOC_MIN << i, KMEM_CACHELINE),
+                NULL);
+        if (!kmalloc_caches[i]) {
+            panic("kmem_init: out of memory");
+        }
+    }
+
+    check_kmem();
+}
+
+struct kmem_cache *kmem_cache_create(const char *name, size_t size,
+                                     size_t align, void (*ctor)(void *)) {
+    struct kmem_cache *kc;
+
+    if (size == 0 || size > KMALLOC_MAX) {
+        return NULL;
+    }
+    if ((kc = kmem_cache_alloc(&kmem_cache_cache)) == NULL) {
+        return NULL;
+    }
+    cache_setup(kc, name, size, align, ctor);
+    return kc;
+}
+
+void kmem_cache_destroy(struct kmem_cache *kc) {
+    int i;
+
+    for (i = 0; i < ncpu; ++i) {
+        cpu_flush(kc, &kc->kc_cpu[i]);
+    }
+    if (kc->kc_inuse) {
+        panic("kmem_cache_destroy: %s has %u objects in use",
+              kc->kc_name, kc->kc_inuse);
+    }
+    kmem_cache_reap(kc);
+
+    spin_lock(&kmem_lock);
+    LIST_REMOVE(kc, kc_link);
+    spin_unlock(&kmem_lock);
+    kmem_cache_free(&kmem_cache_cache, kc);
+}
+
+void *kmem_cache_alloc(struct kmem_cache *kc) {
+    struct kmem_cpu *c = &kc->kc_cpu[cpunum()];
+    void *obj;
+
+    // The kernel runs with interrupts off, so nothing else touches this
+    // CPU's array in the meantime.
+    if (c->kcc_count == 0) {
+        spin_lock(&kc->kc_lock);
+        while (c->kcc_count < KMEM_CPU_BATCH && (obj = slab_get(kc))) {
+            c->kcc_objs[c->kcc_count++] = obj;
+        }
+        spin_unlock(&kc->kc_lock);
+        if (c->kcc_count == 0) {
+            return NULL;
+        }
+    }
+
+    ++c->kcc_allocs;
+    return c->kcc_objs[--c->kcc_count];
+}
+
+void kmem_cache_free(struct kmem_cache *kc, void *obj) {
+    struct kmem_cpu *c = &kc->kc_cpu[cpunum()];
+
+    if (c->kcc_count == KMEM_CPU_MAX) {
+        spin_lock(&kc->kc_lock);
+        while (c->kcc_count > KMEM_CPU_MAX - KMEM_CPU_BATCH) {
+            slab_put(kc, c->kcc_objs[--c->kcc_count]);
+        }
+        spin_unlock(&kc->kc_lock);
+    }
+
+    ++c->kcc_frees;
+    c->kcc_objs[c->kcc_count++] = obj;
+}
+
+size_t kmem_cache_reap(struct kmem_cache *kc) {
+    struct Slab *slab;
+    size_t n = 0;
+
+    cpu_flush(kc, &kc->kc_cpu[cpunum()]);
+
+    spin_lock(&kc->kc_lock);
+    while ((slab = LIST_FIRST(&kc->kc_empty)) != NULL) {
+        LIST_REMOVE(slab, s_link);
+        slab_destroy(kc, slab);
+        n += 1 << kc->kc_order;
+    }
+    spin_unlock(&kc->kc_lock);
+    return n;
+}
+
+void *kmalloc(size_t size) {
+    struct Page *pp;
+    int i;
+
+    if (size == 0) {
+        return NULL;
+    }
+
+    if (size > KMALLOC_MAX) {
+        for (i = 0; (PGSIZE << i) < size; ++i) {
+            /* do nothing */;
+        }
+        if ((pp = pages_alloc(i, 0)) == NULL) {
+            return NULL;
+        }
+        return page2kva(pp);
+    }
+
+    for (i = 0; (KMALLOC_MIN << i) < size; ++i) {
+        /* do nothing */;
+    }
+    return kmem_cache_alloc(kmalloc_caches[i]);
+}
+
+void kfree(void *ptr) {
+    struct Page *pp;
+
+    if (ptr == NULL) {
+        return;
+    }
+
+    pp = pa2page(PADDR(ptr));
+    if (pp->pp_flags & PP_SLAB) {
+        kmem_cache_free(pp->pp_slab->s_cache, ptr);
+    } else {
+        assert(PGOFF(ptr) == 0);
+        pages_free(pp, pp->pp_order);
+    }
+}
+
+void kmem_print(void) {
+    struct kmem_cache *kc;
+    uint32_t allocs, frees, cached;
+    int i;
+
+    cprintf("cache            size order objs slabs   active    total"
+            "   allocs    frees\n");
+    spin_lock(&kmem_lock);
+    LIST_FOREACH(kc, &kmem_caches, kc_link) {
+        allocs = frees = cached = 0;
+        for (i = 0; i < ncpu; ++i) {
+            allocs += kc->kc_cpu[i].kcc_allocs;
+            frees += kc->kc_cpu[i].kcc_frees;
+            cached += kc->kc_cpu[i].kcc_count;
+        }
+        cprintf("%-16s %4u %5d %4d %5u %8u %8u %8u %8u\n",
+                kc->kc_name, kc->kc_size, kc->kc_order, kc->kc_nobjs,
+                kc->kc_nslabs, kc->kc_inuse - cached,
+                kc->kc_nslabs * kc->kc_nobjs, allocs, frees);
+    }
+    spin_unlock(&kmem_lock);
+}
+
+/***** Self test *****/
+
+#define CHECK_MAGIC 0x51ab51ab
+#define CHECK_N     100
+
+// 100 bytes leaves 96 spare in a one-page slab: two colours
+struct check_obj {
+    uint32_t co_magic;
+    char co_pad[96];
+};
+
+static void check_ctor(void *obj) {
+    ((struct check_obj *) obj)->co_magic = CHECK_MAGIC;
+}
+
+/**
+ * Check that objects come out distinct, aligned, constructed and
+ * coloured, keep their constructed state across a free, and that
+ * kmalloc() covers every size class and beyond.
+ */
+static void check_kmem(void) {
+    struct kmem_cache *kc;
+    struct check_obj *objs[CHECK_N];
+    struct Slab *s0, *s1;
+    char *p[KMALLOC_NCLASSES + 1];
+    size_t size;
+    int i, j;
+
+    assert((kc = kmem_cache_create("check", sizeof(struct check_obj), 0,
+                                   check_ctor)));
+    assert(kc->kc_size == 100 && kc->kc_ncolours > 1);
+
+    for (i = 0; i < CHECK_N; ++i) {
+        assert((objs[i] = kmem_cache_alloc(kc)));
+        assert(((uintptr_t) objs[i] & 3) == 0);
+        assert(objs[i]->co_magic == CHECK_MAGIC);
+        for (j = 0; j < i; ++j) {
+            assert(objs[i] != objs[j]);
+        }
+    }
+    assert(kc->kc_nslabs >= 2);
+
+    // successive slabs start at successive colours
+    s0 = pa2page(PADDR(objs[0]))->pp_slab;
+    for (i = 1; i < CHECK_N; ++i) {
+        s1 = pa2page(PADDR(objs[i]))->pp_slab;
+        if (s1 != s0) {
+            break;
+        }
+    }
+    assert(i < CHECK_N);
+    assert(PGOFF(s0->s_mem) - PGOFF(s1->s_mem) == KMEM_CACHELINE ||
+           PGOFF(s1->s_mem) - PGOFF(s0->s_mem) == KMEM_CACHELINE);
+
+    for (i = 0; i < CHECK_N; ++i) {
+        kmem_cache_free(kc, objs[i]);
+    }
+    for (i = 0; i < CHECK_N; ++i) {
+        assert((objs[i] = kmem_cache_alloc(kc)));
+        assert(objs[i]->co_magic == CHECK_MAGIC);
+    }
+    for (i = 0; i < CHECK_N; ++i) {
+        kmem_cache_free(kc, objs[i]);
+    }
+    kmem_cache_destroy(kc);
+
+    // one allocation per size class, and one past KMALLOC_MAX
+    for (i = 0; i <= KMALLOC_NCLASSES; ++i) {
+        size = (KMALLOC_MIN << i) - 1;
+        assert((p[i] = kmalloc(size)));
+        memset(p[i], i, size);
+    }
+    for (i = 0; i <= KMALLOC_NCLASSES; ++i) {
+        size = (KMALLOC_MIN << i) - 1;
+        assert(p[i][0] == i && p[i][size - 1] == i);
+        kfree(p[i]);
+    }
+    assert(kmalloc(0) == NULL);
+    kfree(NULL);
+
+    cprintf("check_kmem() succeeded!\n");
+}
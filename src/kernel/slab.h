@@ -0,0 +1,140 @@
+#ifndef _POTATOS_KERNEL_SLAB_H_
+#define _POTATOS_KERNEL_SLAB_H_
+#ifndef POS_KERNEL
+#error "This is a PotatOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/queue.h>
+
+#include <kernel/cpu.h>
+#include <kernel/spinlock.h>
+
+/**
+ * Slab allocator for kernel objects smaller than a page.
+ *
+ * A kmem_cache hands out objects of one size.  It carves them out of
+ * slabs, blocks of 2^kc_order pages from the page allocator, each with
+ * a small header in front of its objects.  Objects are handed back to
+ * the cache in their constructed state, so a constructor only runs when
+ * a slab is created, not on every allocation.
+ *
+ * Successive slabs start their objects at different cache-line offsets
+ * (colours) within the slack at the end of the slab, so that the first
+ * objects of all the slabs do not compete for the same cache sets.
+ *
+ * Each CPU keeps a small array of free objects per cache, used without
+ * taking the cache's lock; only when it runs empty or full does it go to
+ * the slabs, for KMEM_CPU_BATCH objects at once.
+ *
+ * kmalloc() and kfree() sit on top of a set of power-of-two sized
+ * caches, and go straight to the page allocator above KMALLOC_MAX.
+ */
+
+#define KMEM_CACHELINE  64      // colour step
+#define KMEM_CPU_MAX    16      // per-CPU array size
+#define KMEM_CPU_BATCH  8       // objects moved to or from it at once
+#define KMEM_MAXORDER   3       // largest slab: 2^3 pages
+
+#define KMALLOC_MIN     16
+#define KMALLOC_MAX     2048
+
+LIST_HEAD(Slab_list, Slab);
+
+struct Slab {
+    LIST_ENTRY(Slab) s_link;    // on one of the cache's slab lists
+    struct kmem_cache *s_cache;
+    char *s_mem;                // first object
+    uint16_t s_inuse;           // objects handed out of this slab
+    uint16_t s_free;            // first free object, KMEM_BUFCTL_END if none
+    uint16_t s_bufctl[0];       // per-object free list links
+};
+
+#define KMEM_BUFCTL_END 0xffff
+
+struct kmem_cpu {
+    void *kcc_objs[KMEM_CPU_MAX];
+    int kcc_count;
+    uint32_t kcc_allocs;
+    uint32_t kcc_frees;
+};
+
+struct kmem_cache {
+    LIST_ENTRY(kmem_cache) kc_link;     // on the list of all caches
+    const char *kc_name;
+    size_t kc_size;                     // object size, rounded to kc_align
+    size_t kc_align;
+    void (*kc_ctor)(void *obj);
+
+    int kc_order;                       // slabs are 2^kc_order pages
+    int kc_nobjs;                       // objects per slab
+    size_t kc_offset;                   // first object's offset, uncoloured
+    int kc_ncolours;                    // colours a slab can start at
+    int kc_colour;                      // the next slab's colour
+
+    struct spinlock kc_lock;            // protects everything below
+    struct Slab_list kc_partial;        // some objects free
+    struct Slab_list kc_full;           // no objects free
+    struct Slab_list kc_empty;          // all objects free
+    uint32_t kc_nslabs;
+    uint32_t kc_inuse;                  // objects out of slabs, incl. in
+                                        //   per-CPU arrays
+
+    struct kmem_cpu kc_cpu[NCPU];
+};
+
+/**
+ * Set up the cache of caches and the kmalloc() caches.  Needs the page
+ * allocator.
+ */
+void kmem_init(void);
+
+/**
+ * Create a cache of objects.
+ * @param name   for kmem_print(); must be a string constant
+ * @param size   object size in bytes; at most KMALLOC_MAX
+ * @param align  object alignment, a power of two; 0 for word alignment
+ * @param ctor   called on every object when its slab is created, or NULL
+ * @return  the cache, or NULL if out of memory
+ */
+struct kmem_cache *kmem_cache_create(const char *name, size_t size,
+                                     size_t align, void (*ctor)(void *));
+
+/**
+ * Destroy a cache, giving its slabs back to the page allocator.  Every
+ * object must have been freed.
+ */
+void kmem_cache_destroy(struct kmem_cache *kc);
+
+/**
+ * Allocate an object, NULL if out of memory.
+ */
+void *kmem_cache_alloc(struct kmem_cache *kc);
+
+/**
+ * Free an object allocated from kc, in its constructed state.
+ */
+void kmem_cache_free(struct kmem_cache *kc, void *obj);
+
+/**
+ * Give the cache's empty slabs back to the page allocator.
+ * @return  number of pages freed
+ */
+size_t kmem_cache_reap(struct kmem_cache *kc);
+
+/**
+ * Allocate size bytes of kernel memory, NULL if out of memory.
+ */
+void *kmalloc(size_t size);
+
+/**
+ * Free memory from kmalloc().  kfree(NULL) does nothing.
+ */
+void kfree(void *ptr);
+
+/**
+ * Print each cache's usage on the console.
+ */
+void kmem_print(void);
+
+#endif  // !_POTATOS_KERNEL_SLAB_H_
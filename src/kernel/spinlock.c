@@ -0,0 +1,44 @@
+// Mutual exclusion spin locks.
+
+#include <inc/x86.h>
+#include <inc/assert.h>
+
+#include <kernel/spinlock.h>
+
+void __spin_initlock(struct spinlock *lk, const char *name) {
+    lk->locked = 0;
+    lk->name = name;
+}
+
+/**
+ * Acquire the lock.
+ * Loops (spins) until the lock is acquired.
+ * Holding a lock for a long time may cause
+ * other CPUs to waste time spinning to acquire it.
+ */
+void spin_lock(struct spinlock *lk) {
+    // The xchg is atomic.
+    // It also serializes, so that reads after acquire are not
+    // reordered before it.
+    while (xchg(&lk->locked, 1) != 0) {
+        __asm __volatile("pause");
+    }
+}
+
+// Release the lock.
+void spin_unlock(struct spinlock *lk) {
+    if (!lk->locked) {
+        panic("spin_unlock: %s not locked", lk->name);
+    }
+
+    // The xchg serializes, so that reads before release are
+    // not reordered after it.  The 1996 PentiumPro manual (Volume 3,
+    // 7.2) says reads can be carried out speculatively and in any
+    // order, which implies we need to serialize here.
+    // But the 2007 Intel 64 Architecture Memory Ordering White
+    // Paper says that Intel 64 and IA-32 will not move a load
+    // after a store. So lock->locked = 0 would work here.
+    // The xchg being asm volatile ensures gcc emits it after
+    // the above assignments (and after the critical section).
+    xchg(&lk->locked, 0);
+}
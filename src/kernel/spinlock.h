@@ -0,0 +1,21 @@
+#ifndef _POTATOS_KERNEL_SPINLOCK_H_
+#define _POTATOS_KERNEL_SPINLOCK_H_
+#ifndef POS_KERNEL
+#error "This is a PotatOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+// Mutual exclusion lock.
+struct spinlock {
+    volatile uint32_t locked;   // Is the lock held?
+    const char *name;           // Name of lock, for debugging
+};
+
+void __spin_initlock(struct spinlock *lk, const char *name);
+void spin_lock(struct spinlock *lk);
+void spin_unlock(struct spinlock *lk);
+
+#define spin_initlock(lock) __spin_initlock(lock, #lock)
+
+#endif  // !_POTATOS_KERNEL_SPINLOCK_H_
@@ -0,0 +1,360 @@
+#include <inc/x86.h>
+#include <inc/mmu.h>
+#include <inc/error.h>
+#include <inc/string.h>
+#include <inc/stdio.h>
+#include <inc/assert.h>
+
+#include <kernel/swap.h>
+#include <kernel/zswap.h>
+#include <kernel/pmap.h>
+#include <kernel/pagezero.h>
+#include <kernel/cpu.h>
+#include <kernel/rmap.h>
+#include <kernel/kmap.h>
+#include <kernel/slab.h>
+#include <kernel/ide.h>
+#include <kernel/vm.h>
+
+#define SWAP_DISK   1
+
+struct Swap_stats swap_stats;
+uint32_t swap_nslots, swap_nused;
+
+uint32_t reclaim_low = 32;
+uint32_t reclaim_high = 128;
+
+// How many PTEs hold each slot; 0 if it is free
+static uint8_t *swap_map;
+// where the next slot search starts
+static uint32_t swap_hand;
+// the reclaim clock's hand: a page number
+static size_t clock_hand;
+// pages the hand has passed since reclaim last freed one
+static size_t clock_idle;
+// reclaim() calls still to skip
+static uint32_t reclaim_backoff;
+
+static void check_swap(void);
+
+void swap_init(void) {
+    uint32_t nsecs = ide_probe(SWAP_DISK);
+
+    swap_nslots = MIN(nsecs / SWAP_SLOTSECTS, (uint32_t) SWAP_MAXSLOTS);
+    if (swap_nslots > 0 && !(swap_map = kmalloc(swap_nslots))) {
+        swap_nslots = 0;
+    }
+    if (swap_nslots > 0) {
+        memset(swap_map, 0, swap_nslots);
+        cprintf("swap: %u slots (%uKB) on disk %d\n", swap_nslots,
+                swap_nslots * (PGSIZE / 1024), SWAP_DISK);
+    } else {
+        cprintf("swap: no swap disk\n");
+    }
+    zswap_init();
+    check_swap();
+}
+
+int reclaim_tune(uint32_t low, uint32_t high) {
+    if (low == 0 || low > high) {
+        return -E_INVAL;
+    }
+    reclaim_low = low;
+    reclaim_high = high;
+    return 0;
+}
+
+static int slot_alloc(void) {
+    uint32_t i, slot;
+
+    for (i = 0; i < swap_nslots; ++i) {
+        slot = (swap_hand + i) % swap_nslots;
+        if (swap_map[slot] == 0) {
+            swap_map[slot] = 1;
+            swap_hand = slot + 1;
+            ++swap_nused;
+            return slot;
+        }
+    }
+    return -E_NO_DISK;
+}
+
+// Write pp to a free disk slot for nref PTEs; return the slot, or
+// -E_NO_DISK if there is none, or -E_IO.
+static int swap_write(struct Page *pp, int nref) {
+    void *kva;
+    int slot, r;
+
+    if ((slot = slot_alloc()) < 0) {
+        return slot;
+    }
+    kva = kmap(pp);
+    r = ide_write(SWAP_DISK, slot * SWAP_SLOTSECTS, kva, SWAP_SLOTSECTS);
+    kunmap(kva);
+    if (r < 0) {
+        swap_map[slot] = 0;
+        --swap_nused;
+        return r;
+    }
+    swap_map[slot] = nref;
+    ++swap_stats.sw_swapouts;
+    return slot;
+}
+
+int swap_read(pte_t pte, struct Page *pp) {
+    uint64_t start;
+    void *kva;
+    int r;
+
+    assert(pte_swapped(pte));
+    if (pte & PTE_ZSWAP) {
+        return zswap_load(pte, pp);
+    }
+
+    assert(SWAP_SLOT(pte) < swap_nslots);
+    start = read_tsc();
+    kva = kmap(pp);
+    r = ide_read(SWAP_DISK, SWAP_SLOT(pte) * SWAP_SLOTSECTS, kva,
+                 SWAP_SLOTSECTS);
+    kunmap(kva);
+    if (r == 0) {
+        ++swap_stats.sw_swapins;
+        swap_stats.sw_read_cycles += read_tsc() - start;
+    }
+    return r;
+}
+
+int swap_dup(pte_t pte) {
+    uint32_t slot = SWAP_SLOT(pte);
+
+    if (pte & PTE_ZSWAP) {
+        return zswap_dup(pte);
+    }
+    assert(pte_swapped(pte) && slot < swap_nslots && swap_map[slot] > 0);
+    if (swap_map[slot] == SWAP_MAXREF) {
+        return -E_NO_MEM;
+    }
+    ++swap_map[slot];
+    return 0;
+}
+
+void swap_drop(pte_t pte) {
+    uint32_t slot = SWAP_SLOT(pte);
+
+    if (pte & PTE_ZSWAP) {
+        zswap_drop(pte);
+        return;
+    }
+    assert(pte_swapped(pte) && slot < swap_nslots && swap_map[slot] > 0);
+    if (--swap_map[slot] == 0) {
+        --swap_nused;
+    }
+}
+
+// Whether reclaim can take pp: a 4KB page that only its mappings hold.
+static bool reclaimable(struct Page *pp) {
+    struct Rmap *rm = pp->pp_rmap;
+
+    if (!rm || (rm->rm_pgdir[PDX(rm->rm_va)] & PTE_PS)) {
+        return 0;
+    }
+    return pp->pp_ref == rmap_count(pp);
+}
+
+/**
+ * Give pp its second chance, or take it if it had that already.
+ * @return  1 if pp was freed, 0 if it was kept, or -E_IO
+ */
+static int reclaim_one(struct Page *pp) {
+    struct Rmap *rm;
+    pde_t *pgdir;
+    pte_t *pte, entry;
+    uintptr_t va;
+    bool referenced = 0;
+    int n = 0, r;
+
+    for (rm = pp->pp_rmap; rm; rm = rm->rm_next, ++n) {
+        pte = pgdir_walk(rm->rm_pgdir, (void *) rm->rm_va, 0);
+        if (*pte & PTE_A) {
+            *pte &= ~PTE_A;
+            tlb_invalidate(rm->rm_pgdir, (void *) rm->rm_va);
+            referenced = 1;
+        }
+        if (*pte & PTE_D) {
+            pp->pp_flags &= ~PP_ZEROFILL;
+        }
+    }
+    if (referenced) {
+        ++swap_stats.sw_referenced;
+        return 0;
+    }
+
+    if (pp->pp_flags & PP_ZEROFILL) {
+        entry = 0;
+        ++swap_stats.sw_discards;
+    } else if (n > SWAP_MAXREF) {
+        return 0;
+    } else if ((r = zswap_store(pp, n)) >= 0) {
+        entry = ZSWAP_PTE(r);
+    } else if ((r = swap_write(pp, n)) >= 0) {
+        entry = SWAP_PTE(r);
+    } else {
+        // nowhere to put it: keep it
+        return r == -E_IO ? r : 0;
+    }
+
+    // the last page_decref() frees pp
+    while ((rm = pp->pp_rmap) != NULL) {
+        pgdir = rm->rm_pgdir;
+        va = rm->rm_va;
+        *pgdir_walk(pgdir, (void *) va, 0) = entry;
+        tlb_invalidate(pgdir, (void *) va);
+        rmap_remove(pp, pgdir, va);
+        page_decref(pp);
+    }
+    return 1;
+}
+
+int reclaim(int target) {
+    struct Page *pp;
+    size_t scanned;
+    int freed = 0;
+
+    if (reclaim_backoff > 0) {
+        --reclaim_backoff;
+        return 0;
+    }
+
+    for (scanned = 0; scanned < RECLAIM_SCAN && freed < target; ++scanned) {
+        pp = &pages[clock_hand];
+        clock_hand = (clock_hand + 1) % npages;
+        if (!reclaimable(pp)) {
+            continue;
+        }
+        ++swap_stats.sw_scans;
+        if (reclaim_one(pp) > 0) {
+            ++freed;
+        }
+    }
+
+    // Twice round, since pages the first turn gave a second chance to
+    // are fair game on the second; if that freed nothing, there is
+    // nothing to free, and scanning again on every allocation would
+    // only make each one cost a trip through memory.
+    if (freed > 0) {
+        clock_idle = 0;
+    } else if ((clock_idle += scanned) >= 2 * npages) {
+        clock_idle = 0;
+        reclaim_backoff = RECLAIM_BACKOFF;
+        ++swap_stats.sw_backoffs;
+    }
+    return freed;
+}
+
+// Free pages: in the buddy allocator, this CPU's magazine, the colour
+// buckets and the pre-zeroed pool, which all hand theirs out on demand
+static uint32_t nfree(void) {
+    uint32_t n = thiscpu->cpu_pagemag.pm_count + pagezero_stats.pz_count +
+                 colour_nfree_total();
+    int order;
+
+    for (order = 0; order <= PAGE_MAXORDER; ++order) {
+        n += page_nfree(order) << order;
+    }
+    return n;
+}
+
+void reclaim_balance(void) {
+    uint32_t n = nfree();
+
+    if (n < reclaim_low) {
+        reclaim(reclaim_high - n);
+    }
+}
+
+/**
+ * Swap out the page at va, written with "swapped", to the zswap pool or
+ * to disk, copy vs, and check that both copies read it back.  Leaves the
+ * page mapped and unreferenced again.
+ */
+static void check_swapout(struct Vmspace *vs, uintptr_t va, bool compressed) {
+    struct Vmspace *child;
+    struct Page *pp;
+    uint32_t nused = swap_nused, zpages = zswap_stats.zs_pages;
+    pte_t *pte;
+    char *kva;
+
+    assert((pp = page_lookup(vs->vs_pgdir, (void *) va, &pte)));
+    assert(!(*pte & PTE_A) && reclaim_one(pp) == 1 && pte_swapped(*pte));
+    if (compressed) {
+        assert((*pte & PTE_ZSWAP) && zswap_stats.zs_pages == zpages + 1);
+    } else {
+        assert(!(*pte & PTE_ZSWAP) && swap_nused == nused + 1);
+    }
+
+    // the copy shares the slot, and each reads its own page back
+    assert((child = vmspace_dup(vs)));
+    assert(vm_fault(child, va, 0) == 0);
+    kva = kmap(page_lookup(child->vs_pgdir, (void *) va, NULL));
+    assert(strcmp(kva, "swapped") == 0);
+    kunmap(kva);
+    vmspace_free(child);
+    assert(swap_nused + zswap_stats.zs_pages == nused + zpages + 1);
+
+    assert(vm_fault(vs, va, 1) == 0 && (*pte & PTE_P) && (*pte & PTE_A));
+    assert(swap_nused == nused && zswap_stats.zs_pages == zpages);
+    assert((pp = page_lookup(vs->vs_pgdir, (void *) va, NULL)));
+    kva = kmap(pp);
+    assert(strcmp(kva, "swapped") == 0);
+    kunmap(kva);
+
+    // it came back referenced, which buys it one more turn of the clock
+    assert(reclaim_one(pp) == 0 && !(*pte & PTE_A));
+}
+
+static void check_swap(void) {
+    struct Vmspace *vs;
+    struct Page *pp0, *pp1;
+    uintptr_t va = UTEXT;
+    uint32_t cr3 = rcr3(), maxpool = zswap_maxpool;
+    pte_t *pte;
+    char *kva;
+
+    assert((vs = vmspace_create()));
+    assert(vm_map_zero(vs, va, 2 * PGSIZE, PTE_U | PTE_W) == 0);
+    assert(vm_fault(vs, va, 1) == 0 && vm_fault(vs, va + PGSIZE, 0) == 0);
+    assert((pp0 = page_lookup(vs->vs_pgdir, (void *) va, NULL)));
+    assert((pp1 = page_lookup(vs->vs_pgdir, (void *) (va + PGSIZE), NULL)));
+    assert(reclaimable(pp0) && reclaimable(pp1));
+
+    // write one page the way its owner would, and only read the other
+    lcr3(PADDR(vs->vs_pgdir));
+    strcpy((char *) va, "swapped");
+    (void) *(volatile char *) (va + PGSIZE);
+    lcr3(cr3);
+
+    // both were used, so both get a second chance
+    assert(reclaim_one(pp0) == 0 && reclaim_one(pp1) == 0);
+    assert(page_lookup(vs->vs_pgdir, (void *) va, &pte) == pp0);
+    assert(!(*pte & PTE_A) && (*pte & PTE_D));
+
+    // a page still all zeroes goes without a trace, and comes back zeroed
+    assert(reclaim_one(pp1) == 1);
+    assert(*pgdir_walk(vs->vs_pgdir, (void *) (va + PGSIZE), 0) == 0);
+    assert(vm_fault(vs, va + PGSIZE, 0) == 0);
+    assert(*pgdir_walk(vs->vs_pgdir, (void *) (va + PGSIZE), 0) & PTE_A);
+    kva = kmap(page_lookup(vs->vs_pgdir, (void *) (va + PGSIZE), NULL));
+    assert(kva[0] == 0);
+    kunmap(kva);
+
+    // a written one goes to the pool, or to disk with the pool off
+    check_swapout(vs, va, 1);
+    if (swap_nslots > 0) {
+        zswap_maxpool = 0;
+        check_swapout(vs, va, 0);
+        zswap_maxpool = maxpool;
+    }
+
+    vmspace_free(vs);
+    cprintf("check_swap() succeeded!\n");
+}
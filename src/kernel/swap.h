@@ -0,0 +1,116 @@
+#ifndef _POTATOS_KERNEL_SWAP_H_
+#define _POTATOS_KERNEL_SWAP_H_
+#ifndef POS_KERNEL
+#error "This is a PotatOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/mmu.h>
+#include <inc/memlayout.h>
+
+/**
+ * Page reclaim and swap.
+ *
+ * When free memory drops below reclaim_low pages, a second-chance clock
+ * sweeps struct Page's looking for user pages to take back, until there
+ * are reclaim_high free again.  Each call looks at no more than
+ * RECLAIM_SCAN pages, carrying on where the last one stopped, so an
+ * allocation under pressure costs a bounded amount of scanning; after
+ * two whole turns of the clock free nothing, reclaim sits out the next
+ * RECLAIM_BACKOFF calls.  A page mapped with PTE_A set anywhere
+ * has been used since the hand last passed: the bits are cleared, and
+ * the page is left for the next pass.  A page that was not is unmapped
+ * everywhere, through its rmap chain:
+ *  - if it is still as vm_fault() zeroed it (PP_ZEROFILL, and PTE_D in
+ *    none of its mappings) its PTEs are just cleared, and the next
+ *    fault zeroes a new page;
+ *  - otherwise it is compressed into the zswap pool (kernel/zswap.h) if
+ *    it fits, or else written to a slot of the swap disk (IDE disk 1),
+ *    and its PTEs become swap entries naming the slot, which vm_fault()
+ *    reads back on the next touch: a major fault.
+ *
+ * Each slot counts the PTEs that hold it, since an address space copy
+ * shares swap entries just as it shares pages.
+ *
+ * Only 4KB pages whose every reference is a mapping are reclaimed.
+ * The kernel writing to a user page through kmap() does not set PTE_D,
+ * so it must clear PP_ZEROFILL itself.
+ */
+
+// Each slot holds one page
+#define SWAP_SLOTSECTS      (PGSIZE / 512)
+#define SWAP_MAXSLOTS       65536
+#define SWAP_MAXREF         0xff
+
+// Most struct Page's one reclaim() call looks at
+#define RECLAIM_SCAN        1024
+// reclaim() calls skipped once the clock has gone round twice for nothing
+#define RECLAIM_BACKOFF     64
+
+#define SWAP_PTE(slot)      (((pte_t) (slot) << PGSHIFT) | PTE_SWAP)
+#define SWAP_SLOT(pte)      ((uint32_t) (pte) >> PGSHIFT)
+
+static inline bool pte_swapped(pte_t pte) {
+    return (pte & (PTE_P | PTE_SWAP)) == PTE_SWAP;
+}
+
+struct Swap_stats {
+    uint32_t sw_scans;          // pages the clock hand looked at
+    uint32_t sw_referenced;     // ... that got a second chance
+    uint32_t sw_discards;       // zero-filled pages dropped
+    uint32_t sw_swapouts;       // pages written to the swap disk
+    uint32_t sw_swapins;        // major faults: pages read back from it
+    uint64_t sw_read_cycles;    // ... and the time it took
+    uint32_t sw_failed;         // allocations reclaim could not save
+    uint32_t sw_backoffs;       // times the clock went round for nothing
+};
+
+extern struct Swap_stats swap_stats;
+extern uint32_t swap_nslots, swap_nused;
+
+// Free page watermarks
+extern uint32_t reclaim_low, reclaim_high;
+
+/**
+ * Find the swap disk and set up its slots.  Needs vm_init().
+ */
+void swap_init(void);
+
+/**
+ * Set the watermarks.
+ * @return  0, or -E_INVAL unless 0 < low <= high
+ */
+int reclaim_tune(uint32_t low, uint32_t high);
+
+/**
+ * Reclaim up to target pages, looking at no more than RECLAIM_SCAN.
+ * @return  how many pages were freed
+ */
+int reclaim(int target);
+
+/**
+ * Reclaim up to reclaim_high free pages if there are fewer than
+ * reclaim_low.
+ */
+void reclaim_balance(void);
+
+/**
+ * Read a swapped-out page's contents into pp, from the disk or the
+ * zswap pool.  The slot stays held.
+ * @param pte  a swap entry
+ * @return  0, or -E_IO
+ */
+int swap_read(pte_t pte, struct Page *pp);
+
+/**
+ * One more PTE holds pte's slot.
+ * @return  0, or -E_NO_MEM if SWAP_MAXREF already do
+ */
+int swap_dup(pte_t pte);
+
+/**
+ * One PTE fewer holds pte's slot, which is freed with the last.
+ */
+void swap_drop(pte_t pte);
+
+#endif  // !_POTATOS_KERNEL_SWAP_H_
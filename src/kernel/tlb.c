@@ -0,0 +1,220 @@
+#include <inc/x86.h>
+#include <inc/mmu.h>
+#include <inc/stdio.h>
+#include <inc/assert.h>
+
+#include <kernel/tlb.h>
+#include <kernel/pmap.h>
+#include <kernel/cpu.h>
+#include <kernel/ptwalk.h>
+
+// What Linux settles on without calibration; used if that fails.
+#define TLB_CEILING_DEFAULT 33
+// Pages mapped to calibrate with
+#define TLB_CAL_PAGES       64
+#define TLB_CAL_ROUNDS      16
+
+uint32_t tlb_ceiling = TLB_CEILING_DEFAULT;
+struct Tlb_stats tlb_stats;
+
+static void check_tlb(void);
+
+static void touch(char *va, int npages) {
+    int i;
+
+    for (i = 0; i < npages; ++i) {
+        (void) *(volatile char *) (va + i * PGSIZE);
+    }
+}
+
+/**
+ * Time invalidating and refetching a single page against reloading CR3
+ * and refetching TLB_CAL_PAGES pages, in a scratch address space.  A
+ * full flush pays once, and every page used afterwards pays a walk;
+ * invlpg pays per page.  Their ratio is how many invlpgs the CR3 reload
+ * is worth.
+ */
+static uint32_t tlb_calibrate(void) {
+    char *va = (char *) UTEXT;
+    struct Page *pp;
+    pde_t *pgdir;
+    uint64_t start, single, full;
+    int r, i;
+
+    if (!(pgdir = pgdir_create())) {
+        return TLB_CEILING_DEFAULT;
+    }
+    for (i = 0; i < TLB_CAL_PAGES; ++i) {
+        if (!(pp = page_alloc(0)) ||
+            page_insert(pgdir, pp, va + i * PGSIZE, PTE_W) < 0) {
+            if (pp) {
+                page_free(pp);
+            }
+            pgdir_free(pgdir);
+            return TLB_CEILING_DEFAULT;
+        }
+    }
+
+    lcr3(PADDR(pgdir));
+    touch(va, TLB_CAL_PAGES);
+
+    start = read_tsc();
+    for (r = 0; r < TLB_CAL_ROUNDS; ++r) {
+        for (i = 0; i < TLB_CAL_PAGES; ++i) {
+            invlpg(va + i * PGSIZE);
+            touch(va + i * PGSIZE, 1);
+        }
+    }
+    single = (read_tsc() - start) / (TLB_CAL_ROUNDS * TLB_CAL_PAGES);
+
+    start = read_tsc();
+    for (r = 0; r < TLB_CAL_ROUNDS; ++r) {
+        tlbflush();
+        touch(va, TLB_CAL_PAGES);
+    }
+    full = (read_tsc() - start) / TLB_CAL_ROUNDS;
+
+    lcr3(PADDR(kern_pgdir));
+    pgdir_free(pgdir);
+
+    if (single == 0) {
+        return TLB_CEILING_DEFAULT;
+    }
+    return MAX(MIN(full / single, (uint64_t) TLB_CAL_PAGES), 1ULL);
+}
+
+void tlb_init(void) {
+    tlb_ceiling = tlb_calibrate();
+    cprintf("tlb: invlpg up to %u pages, then reload CR3\n", tlb_ceiling);
+    check_tlb();
+}
+
+void tlb_batch_init(struct Tlbbatch *tb, pde_t *pgdir) {
+    tb->tb_pgdir = pgdir;
+    tb->tb_nranges = 0;
+    tb->tb_npages = 0;
+    tb->tb_all = 0;
+    tb->tb_nfree = 0;
+}
+
+void tlb_batch_add(struct Tlbbatch *tb, uintptr_t va, size_t len) {
+    struct Tlbrange *last;
+
+    tb->tb_npages += len / PGSIZE;
+    if (tb->tb_all) {
+        return;
+    }
+    last = tb->tb_nranges > 0 ? &tb->tb_ranges[tb->tb_nranges - 1] : NULL;
+    if (last && last->tr_end == va) {
+        last->tr_end = va + len;
+    } else if (tb->tb_nranges < TLB_BATCH_RANGES) {
+        tb->tb_ranges[tb->tb_nranges].tr_start = va;
+        tb->tb_ranges[tb->tb_nranges].tr_end = va + len;
+        ++tb->tb_nranges;
+    } else {
+        tb->tb_all = 1;
+    }
+}
+
+void tlb_batch_release(struct Tlbbatch *tb, struct Page *pp, int order) {
+    tb->tb_pages[tb->tb_nfree] = pp;
+    tb->tb_orders[tb->tb_nfree] = order;
+    if (++tb->tb_nfree == TLB_BATCH_PAGES) {
+        tlb_batch_flush(tb);
+    }
+}
+
+/**
+ * Tell the other CPUs to drop their entries for the batch.  There is
+ * only the boot CPU until the local APICs are brought up, so for now
+ * there is nobody to tell.
+ */
+static void tlb_shootdown(struct Tlbbatch *tb) {
+    assert(ncpu == 1);
+}
+
+void tlb_batch_flush(struct Tlbbatch *tb) {
+    struct Tlbrange *tr;
+    struct Page *pp;
+    uintptr_t va;
+    int i;
+
+    if (tb->tb_npages > 0) {
+        ++tlb_stats.ts_batches;
+        if (rcr3() != PADDR(tb->tb_pgdir)) {
+            // not loaded here, so nothing of it is cached here either
+        } else if (tb->tb_all || tb->tb_npages > tlb_ceiling) {
+            tlbflush();
+            ++tlb_stats.ts_full;
+        } else {
+            for (tr = tb->tb_ranges; tr < tb->tb_ranges + tb->tb_nranges;
+                 ++tr) {
+                for (va = tr->tr_start; va < tr->tr_end; va += PGSIZE) {
+                    invlpg((void *) va);
+                }
+            }
+            tlb_stats.ts_invlpg += tb->tb_npages;
+        }
+        tlb_shootdown(tb);
+    }
+
+    for (i = 0; i < tb->tb_nfree; ++i) {
+        pp = tb->tb_pages[i];
+        if (tb->tb_orders[i] == 0) {
+            page_decref(pp);
+        } else if (--pp->pp_ref == 0) {
+            pages_free(pp, tb->tb_orders[i]);
+        }
+    }
+
+    tb->tb_nranges = 0;
+    tb->tb_npages = 0;
+    tb->tb_all = 0;
+    tb->tb_nfree = 0;
+}
+
+/**
+ * Check that a batch holds on to the pages until it flushes, and picks
+ * invlpg or a CR3 reload by tlb_ceiling.
+ */
+static void check_tlb(void) {
+    struct Tlbbatch tb;
+    struct Page *pp[TLB_CAL_PAGES];
+    char *va = (char *) UTEXT;
+    pde_t *pgdir;
+    struct Tlb_stats ts = tlb_stats;
+    int i;
+
+    assert((pgdir = pgdir_create()));
+    for (i = 0; i < TLB_CAL_PAGES; ++i) {
+        assert((pp[i] = page_alloc(0)));
+        assert(page_insert(pgdir, pp[i], va + i * PGSIZE, PTE_W) == 0);
+    }
+    lcr3(PADDR(pgdir));
+    touch(va, TLB_CAL_PAGES);
+
+    // one page: invlpg, and the page is only freed after it
+    tlb_batch_init(&tb, pgdir);
+    pt_unmap(pgdir, (uintptr_t) va, (uintptr_t) va + PGSIZE, &tb);
+    assert(pp[0]->pp_ref == 1 && !page_lookup(pgdir, va, NULL));
+    tlb_batch_flush(&tb);
+    assert(pp[0]->pp_ref == 0);
+    assert(tlb_stats.ts_invlpg == ts.ts_invlpg + 1);
+
+    // all the rest: whichever the ceiling says
+    pt_unmap(pgdir, (uintptr_t) va + PGSIZE,
+                      (uintptr_t) va + TLB_CAL_PAGES * PGSIZE, &tb);
+    tlb_batch_flush(&tb);
+    if (TLB_CAL_PAGES - 1 > tlb_ceiling) {
+        assert(tlb_stats.ts_full == ts.ts_full + 1);
+    } else {
+        assert(tlb_stats.ts_invlpg == ts.ts_invlpg + TLB_CAL_PAGES);
+    }
+    for (i = 0; i < TLB_CAL_PAGES; ++i) {
+        assert(pp[i]->pp_ref == 0);
+    }
+
+    lcr3(PADDR(kern_pgdir));
+    pgdir_free(pgdir);
+    cprintf("check_tlb() succeeded!\n");
+}
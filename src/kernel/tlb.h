@@ -0,0 +1,83 @@
+#ifndef _POTATOS_KERNEL_TLB_H_
+#define _POTATOS_KERNEL_TLB_H_
+#ifndef POS_KERNEL
+#error "This is a PotatOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/memlayout.h>
+
+/**
+ * Deferred TLB invalidation.  Code tearing down many mappings at once
+ * queues what it unmapped in a struct Tlbbatch instead of invalidating
+ * page by page, and tlb_batch_flush() then does it all in one go: an
+ * invlpg per page for a few pages, or a CR3 reload once that is
+ * cheaper.  The crossover, tlb_ceiling, is calibrated at boot.
+ *
+ * The pages that were mapped are only released after the flush, since
+ * until then a stale TLB entry may still reach them.  With more than
+ * one CPU, the flush is also where the one shootdown IPI per batch
+ * belongs.
+ */
+
+#define TLB_BATCH_RANGES    8   // distinct ranges before giving up
+#define TLB_BATCH_PAGES     64  // pages held back before a flush
+
+struct Tlbrange {
+    uintptr_t tr_start;
+    uintptr_t tr_end;
+};
+
+struct Tlbbatch {
+    pde_t *tb_pgdir;
+    struct Tlbrange tb_ranges[TLB_BATCH_RANGES];
+    int tb_nranges;
+    uint32_t tb_npages;             // TLB entries to invalidate
+    bool tb_all;                    // too scattered: flush it all
+
+    // pages to release after the flush, and their orders
+    struct Page *tb_pages[TLB_BATCH_PAGES];
+    uint8_t tb_orders[TLB_BATCH_PAGES];
+    int tb_nfree;
+};
+
+struct Tlb_stats {
+    uint32_t ts_batches;            // tlb_batch_flush() calls with work
+    uint32_t ts_invlpg;             // pages invalidated one by one
+    uint32_t ts_full;               // CR3 reloads instead
+};
+
+// Most pages a batch invalidates one by one
+extern uint32_t tlb_ceiling;
+extern struct Tlb_stats tlb_stats;
+
+/**
+ * Calibrate tlb_ceiling.  Needs the page allocator and kern_pgdir.
+ */
+void tlb_init(void);
+
+/**
+ * Start a batch of unmappings from pgdir.
+ */
+void tlb_batch_init(struct Tlbbatch *tb, pde_t *pgdir);
+
+/**
+ * Queue the invalidation of [va, va + len).
+ */
+void tlb_batch_add(struct Tlbbatch *tb, uintptr_t va, size_t len);
+
+/**
+ * Queue a page, or a 2^order block, to be released after the flush, and
+ * flush now if too many are queued.  A 4MB page (order HUGE_ORDER) has
+ * its block freed on the last reference; anything else goes through
+ * page_decref().
+ */
+void tlb_batch_release(struct Tlbbatch *tb, struct Page *pp, int order);
+
+/**
+ * Invalidate everything queued, then release the queued pages.  The
+ * batch can be used again afterwards.
+ */
+void tlb_batch_flush(struct Tlbbatch *tb);
+
+#endif  // !_POTATOS_KERNEL_TLB_H_
@@ -0,0 +1,658 @@
+#include <inc/x86.h>
+#include <inc/mmu.h>
+#include <inc/error.h>
+#include <inc/string.h>
+#include <inc/stdio.h>
+#include <inc/assert.h>
+
+#include <kernel/vm.h>
+#include <kernel/pmap.h>
+#include <kernel/slab.h>
+#include <kernel/cow.h>
+#include <kernel/tlb.h>
+#include <kernel/ptwalk.h>
+#include <kernel/kmap.h>
+#include <kernel/swap.h>
+
+struct Vm_hugestats vm_hugestats;
+
+static struct kmem_cache *vmregion_cache;
+static struct kmem_cache *vmspace_cache;
+
+// First colour of the next address space, so that two of them don't
+// start their heaps on the same cache sets
+static uint32_t vm_colour_seed;
+
+static void check_vm(void);
+
+void vm_init(void) {
+    vmregion_cache = kmem_cache_create("vmregion", sizeof(struct Vmregion),
+                                       0, NULL);
+    vmspace_cache = kmem_cache_create("vmspace", sizeof(struct Vmspace),
+                                      0, NULL);
+    if (!vmregion_cache || !vmspace_cache) {
+        panic("vm_init: out of memory");
+    }
+
+    check_vm();
+}
+
+static struct Vmregion *region_new(uintptr_t start, uintptr_t end,
+                                   int perm) {
+    struct Vmregion *r;
+
+    if (!(r = kmem_cache_alloc(vmregion_cache))) {
+        return NULL;
+    }
+    memset(r, 0, sizeof(*r));
+    r->vr_start = start;
+    r->vr_end = end;
+    r->vr_perm = perm;
+    return r;
+}
+
+static void region_free(struct Vmregion *r) {
+    LIST_REMOVE(r, vr_link);
+    kmem_cache_free(vmregion_cache, r);
+}
+
+// The region containing va, if any
+static struct Vmregion *region_find(struct Vmspace *vs, uintptr_t va) {
+    struct Vmregion *r;
+
+    LIST_FOREACH(r, &vs->vs_regions, vr_link) {
+        if (va < r->vr_end) {
+            return va >= r->vr_start ? r : NULL;
+        }
+    }
+    return NULL;
+}
+
+struct Vmspace *vmspace_create(void) {
+    struct Vmspace *vs;
+
+    if (!(vs = kmem_cache_alloc(vmspace_cache))) {
+        return NULL;
+    }
+    memset(vs, 0, sizeof(*vs));
+    LIST_INIT(&vs->vs_regions);
+    vs->vs_colour = vm_colour_seed;
+    vm_colour_seed += 5;
+    if (!(vs->vs_pgdir = pgdir_create())) {
+        kmem_cache_free(vmspace_cache, vs);
+        return NULL;
+    }
+
+    if (vm_map_zero(vs, USTACKTOP - VM_STACKSIZE, VM_STACKSIZE,
+                    PTE_U | PTE_W) < 0) {
+        vmspace_free(vs);
+        return NULL;
+    }
+    return vs;
+}
+
+void vmspace_free(struct Vmspace *vs) {
+    while (!LIST_EMPTY(&vs->vs_regions)) {
+        region_free(LIST_FIRST(&vs->vs_regions));
+    }
+    pgdir_free(vs->vs_pgdir);
+    kmem_cache_free(vmspace_cache, vs);
+}
+
+struct Vmspace *vmspace_dup(struct Vmspace *vs) {
+    struct Vmspace *copy;
+    struct Vmregion *r, *nr, *last = NULL;
+
+    if (!(copy = kmem_cache_alloc(vmspace_cache))) {
+        return NULL;
+    }
+    memset(copy, 0, sizeof(*copy));
+    LIST_INIT(&copy->vs_regions);
+    if (!(copy->vs_pgdir = pgdir_create())) {
+        kmem_cache_free(vmspace_cache, copy);
+        return NULL;
+    }
+
+    LIST_FOREACH(r, &vs->vs_regions, vr_link) {
+        if (!(nr = region_new(r->vr_start, r->vr_end, r->vr_perm))) {
+            goto fail;
+        }
+        if (last) {
+            LIST_INSERT_AFTER(last, nr, vr_link);
+        } else {
+            LIST_INSERT_HEAD(&copy->vs_regions, nr, vr_link);
+        }
+        last = nr;
+    }
+    if (cow_copy(copy->vs_pgdir, vs->vs_pgdir) < 0) {
+        goto fail;
+    }
+    return copy;
+
+fail:
+    vmspace_free(copy);
+    return NULL;
+}
+
+int vm_map_zero(struct Vmspace *vs, uintptr_t va, size_t len, int perm) {
+    struct Vmregion *r, *prev = NULL, *next;
+    uintptr_t end = va + len;
+
+    if (PGOFF(va) || PGOFF(len) || len == 0 || end < va || end > UTOP) {
+        return -E_INVAL;
+    }
+    if (!(perm & PTE_U) || (perm & ~(PTE_U | PTE_W | VM_HUGE))) {
+        return -E_INVAL;
+    }
+    if ((perm & VM_HUGE) && (va % PTSIZE || len % PTSIZE)) {
+        return -E_INVAL;
+    }
+
+    LIST_FOREACH(r, &vs->vs_regions, vr_link) {
+        if (r->vr_end <= va) {
+            prev = r;
+            continue;
+        }
+        if (r->vr_start < end) {
+            return -E_INVAL;
+        }
+        break;
+    }
+    next = prev ? LIST_NEXT(prev, vr_link) : LIST_FIRST(&vs->vs_regions);
+
+    // grow a neighbour if we can
+    if (prev && prev->vr_end == va && prev->vr_perm == perm) {
+        prev->vr_end = end;
+        if (next && next->vr_start == end && next->vr_perm == perm) {
+            prev->vr_end = next->vr_end;
+            region_free(next);
+        }
+        return 0;
+    }
+    if (next && next->vr_start == end && next->vr_perm == perm) {
+        next->vr_start = va;
+        return 0;
+    }
+
+    if (!(r = region_new(va, end, perm))) {
+        return -E_NO_MEM;
+    }
+    if (prev) {
+        LIST_INSERT_AFTER(prev, r, vr_link);
+    } else {
+        LIST_INSERT_HEAD(&vs->vs_regions, r, vr_link);
+    }
+    return 0;
+}
+
+// Whether [va, end) cuts into a 4MB page of a VM_HUGE region
+static bool cuts_huge(struct Vmspace *vs, uintptr_t va, uintptr_t end) {
+    struct Vmregion *r;
+
+    LIST_FOREACH(r, &vs->vs_regions, vr_link) {
+        if ((r->vr_perm & VM_HUGE) && r->vr_start < end && va < r->vr_end &&
+            (MAX(va, r->vr_start) % PTSIZE || MIN(end, r->vr_end) % PTSIZE)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int vm_unmap(struct Vmspace *vs, uintptr_t va, size_t len) {
+    struct Vmregion *r, *next, *split;
+    struct Tlbbatch tb;
+    uintptr_t end = va + len, lo, hi;
+
+    if (PGOFF(va) || PGOFF(len) || end < va || end > UTOP) {
+        return -E_INVAL;
+    }
+
+    if (cuts_huge(vs, va, end)) {
+        return -E_INVAL;
+    }
+
+    tlb_batch_init(&tb, vs->vs_pgdir);
+    for (r = LIST_FIRST(&vs->vs_regions); r && r->vr_start < end; r = next) {
+        next = LIST_NEXT(r, vr_link);
+        if (r->vr_end <= va) {
+            continue;
+        }
+
+        lo = MAX(va, r->vr_start);
+        hi = MIN(end, r->vr_end);
+        if (lo > r->vr_start && hi < r->vr_end) {
+            // a hole in the middle: the rest becomes a region of its own
+            if (!(split = region_new(hi, r->vr_end, r->vr_perm))) {
+                tlb_batch_flush(&tb);
+                return -E_NO_MEM;
+            }
+            LIST_INSERT_AFTER(r, split, vr_link);
+            r->vr_end = lo;
+        } else if (lo > r->vr_start) {
+            r->vr_end = lo;
+        } else if (hi < r->vr_end) {
+            r->vr_start = hi;
+        } else {
+            region_free(r);
+            r = NULL;
+        }
+        if (r) {
+            r->vr_flo = r->vr_fhi = 0;
+            r->vr_window = 0;
+        }
+
+        pt_unmap(vs->vs_pgdir, lo, hi, &tb);
+    }
+    tlb_batch_flush(&tb);
+    return 0;
+}
+
+int vm_protect(struct Vmspace *vs, uintptr_t va, size_t len, int perm) {
+    struct Vmregion *r, *split;
+    struct Tlbbatch tb;
+    uintptr_t end = va + len;
+
+    if (PGOFF(va) || PGOFF(len) || end < va || end > UTOP) {
+        return -E_INVAL;
+    }
+    if (!(perm & PTE_U) || (perm & ~(PTE_U | PTE_W))) {
+        return -E_INVAL;
+    }
+    if (cuts_huge(vs, va, end)) {
+        return -E_INVAL;
+    }
+
+    // Split regions at va and end, so that each one is either entirely
+    // inside the range or entirely outside it.
+    LIST_FOREACH(r, &vs->vs_regions, vr_link) {
+        if (r->vr_end <= va) {
+            continue;
+        }
+        if (r->vr_start >= end) {
+            break;
+        }
+        if (r->vr_start < va || r->vr_end > end) {
+            split = region_new(r->vr_start < va ? va : end, r->vr_end,
+                               r->vr_perm);
+            if (!split) {
+                return -E_NO_MEM;
+            }
+            LIST_INSERT_AFTER(r, split, vr_link);
+            r->vr_end = split->vr_start;
+            if (r->vr_start < va) {
+                continue;
+            }
+        }
+        r->vr_perm = perm | (r->vr_perm & VM_HUGE);
+    }
+
+    tlb_batch_init(&tb, vs->vs_pgdir);
+    pt_protect(vs->vs_pgdir, va, end, perm, &tb);
+    tlb_batch_flush(&tb);
+    return 0;
+}
+
+static struct Page *vm_page_alloc_once(struct Vmspace *vs, int alloc_flags) {
+    if (page_colouring) {
+        return page_alloc_colour(vs->vs_colour++, alloc_flags | ALLOC_HIGH);
+    }
+    return page_alloc(alloc_flags | ALLOC_HIGH);
+}
+
+// A page for vs, in its colour order if page_colouring is on, reclaiming
+// others when memory runs low.  A zeroed one is marked PP_ZEROFILL.
+static struct Page *vm_page_alloc(struct Vmspace *vs, int alloc_flags) {
+    struct Page *pp;
+
+    reclaim_balance();
+    if (!(pp = vm_page_alloc_once(vs, alloc_flags))) {
+        reclaim(reclaim_high);
+        if (!(pp = vm_page_alloc_once(vs, alloc_flags))) {
+            ++swap_stats.sw_failed;
+            return NULL;
+        }
+    }
+    if (alloc_flags & ALLOC_ZERO) {
+        pp->pp_flags |= PP_ZEROFILL;
+    }
+    return pp;
+}
+
+int vm_fault(struct Vmspace *vs, uintptr_t va, bool write) {
+    struct Vmregion *r;
+    struct Page *pp;
+    pte_t *pte;
+    uintptr_t lo, hi, a;
+    int perm, window, n = 1, err;
+
+    va = ROUNDDOWN(va, PGSIZE);
+    if (!(r = region_find(vs, va)) || (write && !(r->vr_perm & PTE_W))) {
+        return -E_FAULT;
+    }
+    perm = r->vr_perm & ~VM_HUGE;
+
+    // First touch of a 4MB-page region's 4MB: try for a 4MB page.
+    if ((r->vr_perm & VM_HUGE) && !(vs->vs_pgdir[PDX(va)] & PTE_P)) {
+        if ((pp = pages_alloc(HUGE_ORDER, ALLOC_ZERO | ALLOC_HIGH))) {
+            if (page_insert_huge(vs->vs_pgdir, pp,
+                                 (void *) ROUNDDOWN(va, PTSIZE), perm) == 0) {
+                ++vm_hugestats.vh_huge;
+                ++vs->vs_faults;
+                vs->vs_mapped += NPTENTRIES;
+                return 0;
+            }
+            pages_free(pp, HUGE_ORDER);
+        }
+        ++vm_hugestats.vh_fallback;
+    }
+
+    pte = pgdir_walk(vs->vs_pgdir, (void *) va, 0);
+    if (pte && (*pte & PTE_P)) {
+        if (write && (*pte & PTE_COW)) {
+            return cow_fault(vs->vs_pgdir, (void *) va);
+        }
+        // someone else mapped it first
+        return write && !(*pte & PTE_W) ? -E_FAULT : 0;
+    }
+
+    // a major fault: read the page back, and page_insert() lets go of
+    // the slot
+    if (pte && pte_swapped(*pte)) {
+        if (!(pp = vm_page_alloc(vs, 0))) {
+            return -E_NO_MEM;
+        }
+        if ((err = swap_read(*pte, pp)) < 0 ||
+            (err = page_insert(vs->vs_pgdir, pp, (void *) va,
+                               perm | PTE_A)) < 0) {
+            page_free(pp);
+            return err;
+        }
+        ++vs->vs_faults;
+        ++vs->vs_mapped;
+        return 0;
+    }
+
+    // Carrying on where the last window ended, up or down, doubles the
+    // window; anything else starts over with just the faulting page.
+    window = MIN(MAX(r->vr_window, 1) * 2, VM_FAULTAROUND);
+    if (va == r->vr_fhi) {
+        lo = va;
+        hi = MIN(va + window * PGSIZE, r->vr_end);
+    } else if (va + PGSIZE == r->vr_flo) {
+        hi = va + PGSIZE;
+        lo = hi - r->vr_start > window * PGSIZE ?
+             hi - window * PGSIZE : r->vr_start;
+    } else {
+        window = 1;
+        lo = va;
+        hi = va + PGSIZE;
+    }
+    // leave the rest of a 4MB-page region to 4MB pages
+    if (r->vr_perm & VM_HUGE) {
+        lo = MAX(lo, ROUNDDOWN(va, PTSIZE));
+        hi = MIN(hi, ROUNDDOWN(va, PTSIZE) + PTSIZE);
+    }
+
+    // The faulting page goes in referenced, as the access that faulted
+    // will leave it: the fault-around allocations below may reclaim, and
+    // must not take it straight back.
+    if (!(pp = vm_page_alloc(vs, ALLOC_ZERO))) {
+        return -E_NO_MEM;
+    }
+    if (page_insert(vs->vs_pgdir, pp, (void *) va, perm | PTE_A) < 0) {
+        page_free(pp);
+        return -E_NO_MEM;
+    }
+
+    // the neighbours are only a guess, so give up on them quietly
+    for (a = lo; a < hi; a += PGSIZE) {
+        // mapped, or swapped out
+        if (a == va || ((pte = pgdir_walk(vs->vs_pgdir, (void *) a, 0)) &&
+                        *pte != 0)) {
+            continue;
+        }
+        if (!(pp = vm_page_alloc(vs, ALLOC_ZERO))) {
+            break;
+        }
+        if (page_insert(vs->vs_pgdir, pp, (void *) a, perm) < 0) {
+            page_free(pp);
+            break;
+        }
+        ++n;
+    }
+
+    r->vr_flo = lo;
+    r->vr_fhi = hi;
+    r->vr_window = window;
+    ++vs->vs_faults;
+    vs->vs_mapped += n;
+    return 0;
+}
+
+static int nregions(struct Vmspace *vs) {
+    struct Vmregion *r;
+    int n = 0;
+
+    LIST_FOREACH(r, &vs->vs_regions, vr_link) {
+        ++n;
+    }
+    return n;
+}
+
+static bool mapped(struct Vmspace *vs, uintptr_t va) {
+    return page_lookup(vs->vs_pgdir, (void *) va, NULL) != NULL;
+}
+
+/**
+ * Check that regions cost nothing until touched, that faults fill them
+ * with zeroes, growing the window on sequential access, and that they
+ * merge, split and copy as they should.
+ */
+static void check_vm(void) {
+    struct Vmspace *vs, *child;
+    uintptr_t stack = USTACKTOP - PGSIZE, heap = UTEXT, big = 16 * PTSIZE;
+    uint32_t nhuge, nfallback, *kva;
+    pte_t *pte;
+    int i;
+
+    assert((vs = vmspace_create()));
+    assert(nregions(vs) == 1 && !mapped(vs, stack));
+
+    // the stack fills downwards: 1 page, then 2, then 4
+    assert(vm_fault(vs, stack + 8, 1) == 0);
+    assert(mapped(vs, stack) && !mapped(vs, stack - PGSIZE));
+    kva = kmap(page_lookup(vs->vs_pgdir, (void *) stack, NULL));
+    assert(*kva == 0);
+    kunmap(kva);
+    assert(vm_fault(vs, stack - PGSIZE, 1) == 0);
+    assert(mapped(vs, stack - 2 * PGSIZE) && !mapped(vs, stack - 3 * PGSIZE));
+    assert(vm_fault(vs, stack - 3 * PGSIZE, 0) == 0);
+    for (i = 3; i <= 6; ++i) {
+        assert(mapped(vs, stack - i * PGSIZE));
+    }
+    assert(!mapped(vs, stack - 7 * PGSIZE));
+    assert(vs->vs_faults == 3 && vs->vs_mapped == 7);
+
+    // growing the heap a bit at a time keeps it one region
+    assert(vm_fault(vs, heap, 0) == -E_FAULT);
+    assert(vm_map_zero(vs, heap, 4 * PGSIZE, PTE_U | PTE_W) == 0);
+    assert(vm_map_zero(vs, heap + 4 * PGSIZE, 4 * PGSIZE,
+                       PTE_U | PTE_W) == 0);
+    assert(nregions(vs) == 2);
+    assert(vm_map_zero(vs, heap + 2 * PGSIZE, PGSIZE, PTE_U) == -E_INVAL);
+    assert(vm_map_zero(vs, heap + 8 * PGSIZE, PGSIZE, PTE_U) == 0);
+    assert(nregions(vs) == 3);
+    assert(vm_fault(vs, heap + 8 * PGSIZE, 1) == -E_FAULT);
+    assert(vm_fault(vs, heap + 8 * PGSIZE, 0) == 0);
+
+    // a hole in the middle splits it, and unmaps what was there
+    assert(vm_fault(vs, heap + 2 * PGSIZE, 1) == 0);
+    assert(vm_unmap(vs, heap + 2 * PGSIZE, 2 * PGSIZE) == 0);
+    assert(nregions(vs) == 4 && !mapped(vs, heap + 2 * PGSIZE));
+    assert(vm_fault(vs, heap + 3 * PGSIZE, 0) == -E_FAULT);
+
+    // 4MB pages, or 4KB ones if there is no free 4MB block
+    assert(vm_map_zero(vs, big + PGSIZE, PTSIZE, PTE_U | VM_HUGE) == -E_INVAL);
+    assert(vm_map_zero(vs, big, 2 * PTSIZE, PTE_U | PTE_W | VM_HUGE) == 0);
+    nhuge = vm_hugestats.vh_huge;
+    nfallback = vm_hugestats.vh_fallback;
+    assert(vm_fault(vs, big + PTSIZE + 5 * PGSIZE, 1) == 0);
+    pte = pgdir_walk(vs->vs_pgdir, (void *) (big + PTSIZE + 5 * PGSIZE), 0);
+    assert(pte && (*pte & PTE_P));
+    if (vm_hugestats.vh_huge == nhuge + 1) {
+        assert(*pte & PTE_PS);
+    } else {
+        assert(vm_hugestats.vh_fallback == nfallback + 1);
+        assert(!(*pte & PTE_PS));
+    }
+    assert(vm_unmap(vs, big, PGSIZE) == -E_INVAL);
+    assert(vm_unmap(vs, big, PTSIZE) == 0);
+
+    // write-protecting part of the heap splits it again
+    assert(vm_fault(vs, heap + 5 * PGSIZE, 1) == 0);
+    assert(vm_protect(vs, heap + 5 * PGSIZE, PGSIZE, PTE_U) == 0);
+    assert(nregions(vs) == 7);
+    assert(vm_fault(vs, heap + 5 * PGSIZE, 1) == -E_FAULT);
+    assert(vm_fault(vs, heap + 6 * PGSIZE, 1) == 0);
+    assert(page_lookup(vs->vs_pgdir, (void *) (heap + 5 * PGSIZE), &pte));
+    assert(!(*pte & PTE_W));
+
+    // a copy shares what is mapped, and maps the rest on its own
+    assert((child = vmspace_dup(vs)));
+    assert(nregions(child) == 7);
+    assert(page_lookup(child->vs_pgdir, (void *) stack, NULL) ==
+           page_lookup(vs->vs_pgdir, (void *) stack, NULL));
+    assert(vm_fault(child, stack, 1) == 0);
+    assert(page_lookup(child->vs_pgdir, (void *) stack, NULL) !=
+           page_lookup(vs->vs_pgdir, (void *) stack, NULL));
+    assert(vm_fault(child, heap, 1) == 0 && !mapped(vs, heap));
+
+    vmspace_free(child);
+    vmspace_free(vs);
+    cprintf("check_vm() succeeded!\n");
+}
+
+
+#define COLOUR_BENCH_MAXPAGES   1024
+#define COLOUR_BENCH_PASSES     16
+
+// Cycles per sweep over npages pages at UTEXT in vs: a cache line of
+// every page, then the next line of every page, and so on.
+static uint64_t sweep_cycles(struct Vmspace *vs, int npages) {
+    uint32_t cr3 = rcr3();
+    uint64_t start = 0;
+    uint32_t off;
+    int pass, i;
+
+    lcr3(PADDR(vs->vs_pgdir));
+    // the first pass only warms the cache up
+    for (pass = 0; pass <= COLOUR_BENCH_PASSES; ++pass) {
+        if (pass == 1) {
+            start = read_tsc();
+        }
+        for (off = 0; off < PGSIZE; off += page_cache_line) {
+            for (i = 0; i < npages; ++i) {
+                (void) *(volatile char *) (UTEXT + i * PGSIZE + off);
+            }
+        }
+    }
+    start = read_tsc() - start;
+    lcr3(cr3);
+    return start / COLOUR_BENCH_PASSES;
+}
+
+// Map npages pages at UTEXT in vs, picked at random from 2 * npages
+// page_alloc() hands out: what a long-running system's free list looks
+// like.
+static int map_random(struct Vmspace *vs, int npages) {
+    struct Page **pp, *t;
+    uint32_t seed = 12345;
+    int i, j, r = 0;
+
+    if (!(pp = kmalloc(2 * npages * sizeof(*pp)))) {
+        return -E_NO_MEM;
+    }
+    for (i = 0; i < 2 * npages; ++i) {
+        if (!(pp[i] = page_alloc(ALLOC_HIGH))) {
+            r = -E_NO_MEM;
+            break;
+        }
+    }
+    for (j = i - 1; r == 0 && j > 0; --j) {
+        seed = seed * 1103515245 + 12345;
+        t = pp[j];
+        pp[j] = pp[(seed >> 8) % (j + 1)];
+        pp[(seed >> 8) % (j + 1)] = t;
+    }
+    for (j = 0; r == 0 && j < npages; ++j) {
+        r = page_insert(vs->vs_pgdir, pp[j], (void *) (UTEXT + j * PGSIZE),
+                        PTE_U | PTE_W);
+    }
+    // those that made it into vs are freed with it
+    for (j = 0; j < i; ++j) {
+        if (pp[j]->pp_ref == 0) {
+            page_free(pp[j]);
+        }
+    }
+    kfree(pp);
+    return r;
+}
+
+// Map npages pages at UTEXT in vs the way vm_fault() does with
+// page_colouring on.
+static int map_coloured(struct Vmspace *vs, int npages) {
+    bool colouring = page_colouring;
+    int i, r;
+
+    page_colouring = 1;
+    r = vm_map_zero(vs, UTEXT, npages * PGSIZE, PTE_U | PTE_W);
+    for (i = 0; r == 0 && i < npages; ++i) {
+        if (!page_lookup(vs->vs_pgdir, (void *) (UTEXT + i * PGSIZE), NULL)) {
+            r = vm_fault(vs, UTEXT + i * PGSIZE, 1);
+        }
+    }
+    page_colouring = colouring;
+    return r;
+}
+
+void vm_colour_bench(void) {
+    struct Vmspace *vs;
+    uint64_t random = 0, coloured = 0;
+    int npages, r;
+
+    if (page_ncolours == 1 || !page_cache_line) {
+        cprintf("colour: no L2 geometry to colour pages by\n");
+        return;
+    }
+    npages = MIN(page_ncolours * page_cache_ways,
+                 (uint32_t) COLOUR_BENCH_MAXPAGES);
+
+    if (!(vs = vmspace_create())) {
+        goto nomem;
+    }
+    r = map_random(vs, npages);
+    if (r == 0) {
+        random = sweep_cycles(vs, npages);
+    }
+    vmspace_free(vs);
+    if (r < 0 || !(vs = vmspace_create())) {
+        goto nomem;
+    }
+    r = map_coloured(vs, npages);
+    if (r == 0) {
+        coloured = sweep_cycles(vs, npages);
+    }
+    vmspace_free(vs);
+    colour_drain();
+    if (r < 0) {
+        goto nomem;
+    }
+
+    cprintf("colour: %d pages (%u colours x %u ways), cycles per sweep: "
+            "%llu placed at random, %llu coloured\n", npages, page_ncolours,
+            page_cache_ways, random, coloured);
+    return;
+
+nomem:
+    cprintf("colour: out of memory\n");
+}
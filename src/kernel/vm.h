@@ -0,0 +1,134 @@
+#ifndef _POTATOS_KERNEL_VM_H_
+#define _POTATOS_KERNEL_VM_H_
+#ifndef POS_KERNEL
+#error "This is a PotatOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/queue.h>
+#include <inc/memlayout.h>
+
+/**
+ * User address spaces, described by regions.  Reserving memory -- a
+ * heap growing, a stack being set up -- only records a demand-zero
+ * region; no page is allocated until the first fault on it, when
+ * vm_fault() maps a zeroed page.  A run of faults walking through a
+ * region in one direction, as a stack or a heap being filled does,
+ * maps a growing window of neighbouring pages at once (fault-around),
+ * up to VM_FAULTAROUND pages.
+ *
+ * A region mapped with VM_HUGE is backed by 4MB pages: the first fault in
+ * each 4MB of it maps a whole 4MB page, if the page allocator has a
+ * free 4MB block.  Where it does not, that 4MB falls back to ordinary
+ * pages.
+ */
+
+// vm_map_zero() flag asking for 4MB pages.  It is above the PTE flag
+// bits, so no region permission ever reaches a PTE as PTE_PS, which in
+// a 4KB PTE is PTE_PAT.
+#define VM_HUGE         0x1000
+
+// Most pages one fault maps
+#define VM_FAULTAROUND  16
+
+// The user stack reserved below USTACKTOP by vmspace_create()
+#define VM_STACKSIZE    (256 * PGSIZE)
+
+LIST_HEAD(Vmregion_list, Vmregion);
+
+struct Vmregion {
+    LIST_ENTRY(Vmregion) vr_link;   // on vs_regions, by address
+    uintptr_t vr_start;
+    uintptr_t vr_end;               // exclusive
+    int vr_perm;                    // PTE_U, PTE_W, VM_HUGE
+
+    // last fault-around window, [vr_flo, vr_fhi), and its size
+    uintptr_t vr_flo;
+    uintptr_t vr_fhi;
+    int vr_window;
+};
+
+struct Vm_hugestats {
+    uint32_t vh_huge;               // 4MB faults that got a 4MB page
+    uint32_t vh_fallback;           // ... that fell back to 4KB pages
+};
+
+extern struct Vm_hugestats vm_hugestats;
+
+struct Vmspace {
+    pde_t *vs_pgdir;
+    struct Vmregion_list vs_regions;
+
+    uint32_t vs_faults;             // demand-zero faults taken
+    uint32_t vs_mapped;             // pages they mapped
+    uint32_t vs_colour;             // next page colour, with page_colouring
+};
+
+/**
+ * Set up the region and address space caches.  Needs kmem_init().
+ */
+void vm_init(void);
+
+/**
+ * Make an address space with nothing but a demand-zero stack of
+ * VM_STACKSIZE below USTACKTOP.
+ * @return  the address space, or NULL if out of memory
+ */
+struct Vmspace *vmspace_create(void);
+
+/**
+ * Free an address space, its regions and everything mapped in it.
+ */
+void vmspace_free(struct Vmspace *vs);
+
+/**
+ * Duplicate an address space, copy-on-write (see cow.h).
+ * @return  the copy, or NULL if out of memory
+ */
+struct Vmspace *vmspace_dup(struct Vmspace *vs);
+
+/**
+ * Reserve [va, va + len) as demand-zero memory.  A region right next to
+ * one with the same permissions extends it, so growing a heap a bit at
+ * a time keeps it a single region.
+ * @param perm  PTE_U, optionally PTE_W, and VM_HUGE for 4MB pages
+ * @return  0; -E_INVAL if the range is not page aligned (4MB aligned
+ *          with VM_HUGE), not below UTOP, or overlaps a region; -E_NO_MEM
+ */
+int vm_map_zero(struct Vmspace *vs, uintptr_t va, size_t len, int perm);
+
+/**
+ * Release [va, va + len): unmap whatever pages it has, and cut it out of
+ * the regions it overlaps.
+ * @return  0; -E_INVAL if the range is not page aligned, or would cut
+ *          a VM_HUGE region other than at 4MB boundaries; -E_NO_MEM if a
+ *          region would need splitting and there is no memory for that
+ */
+int vm_unmap(struct Vmspace *vs, uintptr_t va, size_t len);
+
+/**
+ * Change the permissions of [va, va + len), in the regions it overlaps
+ * and in whatever is mapped there.
+ * @param perm  PTE_U, optionally PTE_W
+ * @return  0; -E_INVAL if the range is not page aligned or would cut a
+ *          VM_HUGE region other than at 4MB boundaries; -E_NO_MEM if a
+ *          region would need splitting and there is no memory for that
+ */
+int vm_protect(struct Vmspace *vs, uintptr_t va, size_t len, int perm);
+
+/**
+ * Handle a page fault at va.
+ * @param write  whether it was a write
+ * @return  0 if the access can be retried; -E_FAULT if it is not to a
+ *          region, or not allowed by it; -E_NO_MEM
+ */
+int vm_fault(struct Vmspace *vs, uintptr_t va, bool write);
+
+/**
+ * Time sweeps over an L2 cache's worth of pages with a page stride, in
+ * pages placed at random and in pages given out by colour, and print
+ * the result.
+ */
+void vm_colour_bench(void);
+
+#endif  // !_POTATOS_KERNEL_VM_H_
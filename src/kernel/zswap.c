@@ -0,0 +1,227 @@
+#include <inc/x86.h>
+#include <inc/mmu.h>
+#include <inc/error.h>
+#include <inc/string.h>
+#include <inc/stdio.h>
+#include <inc/assert.h>
+#include <inc/lz4.h>
+
+#include <kernel/zswap.h>
+#include <kernel/swap.h>
+#include <kernel/pmap.h>
+#include <kernel/kmap.h>
+#include <kernel/slab.h>
+
+struct Zswap_stats zswap_stats;
+uint32_t zswap_maxpool;
+
+struct Zslot {
+    void *z_data;               // the compressed page
+    uint16_t z_size;            // ... its size
+    uint8_t z_ref;              // PTEs that hold it; 0 if the slot is free
+};
+
+static struct Zslot *zslots;
+// where the next slot search starts
+static uint32_t zslot_hand;
+
+static struct kmem_cache *zswap_caches[ZSWAP_NCLASSES];
+static const char *zswap_names[ZSWAP_NCLASSES] = {
+    "zswap-256", "zswap-512", "zswap-768", "zswap-1024",
+    "zswap-1280", "zswap-1536", "zswap-1792", "zswap-2048",
+};
+_Static_assert(ZSWAP_NCLASSES == 8, "zswap_names does not match the classes");
+
+// Compression scratch space; reclaim runs on one CPU at a time
+static uint8_t zswap_buf[ZSWAP_MAXSIZE];
+static uint16_t zswap_hash[LZ4_HASHSIZE];
+
+static void check_zswap(void);
+
+void zswap_init(void) {
+    int i;
+
+    if (!(zslots = kmalloc(ZSWAP_MAXSLOTS * sizeof(struct Zslot)))) {
+        panic("zswap_init: out of memory");
+    }
+    memset(zslots, 0, ZSWAP_MAXSLOTS * sizeof(struct Zslot));
+    for (i = 0; i < ZSWAP_NCLASSES; ++i) {
+        if (!(zswap_caches[i] = kmem_cache_create(zswap_names[i],
+                                                  (i + 1) * ZSWAP_CLASSSTEP,
+                                                  0, NULL))) {
+            panic("zswap_init: out of memory");
+        }
+    }
+    zswap_maxpool = npages / 4;
+    check_zswap();
+}
+
+static int zslot_alloc(void) {
+    uint32_t i, slot;
+
+    for (i = 0; i < ZSWAP_MAXSLOTS; ++i) {
+        slot = (zslot_hand + i) % ZSWAP_MAXSLOTS;
+        if (zslots[slot].z_ref == 0) {
+            zslot_hand = slot + 1;
+            return slot;
+        }
+    }
+    return -E_NO_MEM;
+}
+
+uint32_t zswap_slab_pages(void) {
+    uint32_t n = 0;
+    int i;
+
+    for (i = 0; i < ZSWAP_NCLASSES; ++i) {
+        n += zswap_caches[i]->kc_nslabs << zswap_caches[i]->kc_order;
+    }
+    return n;
+}
+
+// Whether the pool has reached zswap_maxpool, after giving back any
+// empty slabs
+static bool zswap_full(void) {
+    int i;
+
+    if (zswap_slab_pages() < zswap_maxpool) {
+        return 0;
+    }
+    for (i = 0; i < ZSWAP_NCLASSES; ++i) {
+        kmem_cache_reap(zswap_caches[i]);
+    }
+    return zswap_slab_pages() >= zswap_maxpool;
+}
+
+int zswap_store(struct Page *pp, int nref) {
+    struct Zslot *z;
+    void *kva;
+    int size, slot, class;
+
+    assert(nref > 0 && nref <= SWAP_MAXREF);
+    if (zswap_full()) {
+        ++zswap_stats.zs_full;
+        return -E_NO_MEM;
+    }
+
+    kva = kmap(pp);
+    size = lz4_compress(zswap_buf, ZSWAP_MAXSIZE, kva, PGSIZE, zswap_hash);
+    kunmap(kva);
+    if (size < 0) {
+        ++zswap_stats.zs_rejects;
+        return -E_INVAL;
+    }
+
+    class = (size - 1) / ZSWAP_CLASSSTEP;
+    if ((slot = zslot_alloc()) < 0) {
+        ++zswap_stats.zs_full;
+        return slot;
+    }
+    z = &zslots[slot];
+    if (!(z->z_data = kmem_cache_alloc(zswap_caches[class]))) {
+        ++zswap_stats.zs_full;
+        return -E_NO_MEM;
+    }
+    memmove(z->z_data, zswap_buf, size);
+    z->z_size = size;
+    z->z_ref = nref;
+
+    ++zswap_stats.zs_stores;
+    ++zswap_stats.zs_pages;
+    zswap_stats.zs_bytes += size;
+    zswap_stats.zs_pool += (class + 1) * ZSWAP_CLASSSTEP;
+    return slot;
+}
+
+int zswap_load(pte_t pte, struct Page *pp) {
+    struct Zslot *z = &zslots[SWAP_SLOT(pte)];
+    uint64_t start = read_tsc();
+    void *kva;
+    int r;
+
+    assert((pte & PTE_ZSWAP) && SWAP_SLOT(pte) < ZSWAP_MAXSLOTS);
+    assert(z->z_ref > 0);
+    kva = kmap(pp);
+    r = lz4_decompress(kva, PGSIZE, z->z_data, z->z_size);
+    kunmap(kva);
+    // the pool is kernel memory: a bad block means something overwrote it
+    if (r != PGSIZE) {
+        panic("zswap_load: slot %u is corrupt", SWAP_SLOT(pte));
+    }
+
+    ++zswap_stats.zs_loads;
+    zswap_stats.zs_load_cycles += read_tsc() - start;
+    return 0;
+}
+
+int zswap_dup(pte_t pte) {
+    struct Zslot *z = &zslots[SWAP_SLOT(pte)];
+
+    assert((pte & PTE_ZSWAP) && SWAP_SLOT(pte) < ZSWAP_MAXSLOTS);
+    assert(z->z_ref > 0);
+    if (z->z_ref == SWAP_MAXREF) {
+        return -E_NO_MEM;
+    }
+    ++z->z_ref;
+    return 0;
+}
+
+void zswap_drop(pte_t pte) {
+    struct Zslot *z = &zslots[SWAP_SLOT(pte)];
+    int class;
+
+    assert((pte & PTE_ZSWAP) && SWAP_SLOT(pte) < ZSWAP_MAXSLOTS);
+    assert(z->z_ref > 0);
+    if (--z->z_ref > 0) {
+        return;
+    }
+
+    class = (z->z_size - 1) / ZSWAP_CLASSSTEP;
+    kmem_cache_free(zswap_caches[class], z->z_data);
+    z->z_data = NULL;
+    --zswap_stats.zs_pages;
+    zswap_stats.zs_bytes -= z->z_size;
+    zswap_stats.zs_pool -= (class + 1) * ZSWAP_CLASSSTEP;
+}
+
+/**
+ * Check that a page of text round-trips through the pool, and that one
+ * of noise is turned away for disk.
+ */
+static void check_zswap(void) {
+    struct Page *pp;
+    uint32_t *p, seed = 1, maxpool;
+    int slot, i;
+
+    assert((pp = page_alloc(0)));
+    p = page2kva(pp);
+    for (i = 0; i < PGSIZE / 4; ++i) {
+        p[i] = 0x746f7270 + i % 13;
+    }
+    assert((slot = zswap_store(pp, 2)) >= 0);
+    assert(zswap_stats.zs_pages == 1 && zswap_stats.zs_bytes < PGSIZE / 4);
+
+    // the slab holding it counts in full, however little of it is used
+    maxpool = zswap_maxpool;
+    zswap_maxpool = zswap_slab_pages();
+    assert(zswap_maxpool > 0 && zswap_store(pp, 1) == -E_NO_MEM);
+    zswap_maxpool = maxpool;
+    memset(p, 0, PGSIZE);
+    assert(zswap_load(ZSWAP_PTE(slot), pp) == 0);
+    for (i = 0; i < PGSIZE / 4; ++i) {
+        assert(p[i] == 0x746f7270 + i % 13);
+    }
+    zswap_drop(ZSWAP_PTE(slot));
+    assert(zswap_stats.zs_pages == 1);
+    zswap_drop(ZSWAP_PTE(slot));
+    assert(zswap_stats.zs_pages == 0 && zswap_stats.zs_pool == 0);
+
+    for (i = 0; i < PGSIZE / 4; ++i) {
+        seed = seed * 1103515245 + 12345;
+        p[i] = seed;
+    }
+    assert(zswap_store(pp, 1) == -E_INVAL);
+
+    page_free(pp);
+    cprintf("check_zswap() succeeded!\n");
+}
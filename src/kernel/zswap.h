@@ -0,0 +1,86 @@
+#ifndef _POTATOS_KERNEL_ZSWAP_H_
+#define _POTATOS_KERNEL_ZSWAP_H_
+#ifndef POS_KERNEL
+#error "This is a PotatOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/mmu.h>
+#include <inc/memlayout.h>
+
+/**
+ * Compressed swap: a pool of LZ4-compressed pages in memory, in front of
+ * the swap disk.  Reclaim offers each page it is about to write out to
+ * the pool first, and only a page that does not compress to
+ * ZSWAP_MAXSIZE bytes, or finds the pool full, goes on to disk.  A
+ * major fault on a pooled page costs a decompression rather than a PIO
+ * disk read.
+ *
+ * Pooled pages' swap entries carry PTE_ZSWAP, and their slot numbers
+ * index the pool's own slot table.  The compressed data lives in slab
+ * caches, one for every ZSWAP_CLASSSTEP bytes of size up to
+ * ZSWAP_MAXSIZE, which wastes less than kmalloc()'s powers of two.
+ *
+ * The pool holds at most zswap_maxpool pages of slab memory; a quarter
+ * of RAM to start with.  0 turns it off.  What counts is every slab the
+ * zswap caches own, partly used and empty ones included, not just the
+ * objects in them.
+ */
+
+#define ZSWAP_MAXSLOTS      16384
+#define ZSWAP_MAXSIZE       (PGSIZE / 2)
+#define ZSWAP_CLASSSTEP     256
+#define ZSWAP_NCLASSES      (ZSWAP_MAXSIZE / ZSWAP_CLASSSTEP)
+
+#define ZSWAP_PTE(slot)     (((pte_t) (slot) << PGSHIFT) | PTE_ZSWAP | PTE_SWAP)
+
+struct Zswap_stats {
+    uint32_t zs_stores;         // pages compressed into the pool
+    uint32_t zs_rejects;        // pages that did not compress enough
+    uint32_t zs_full;           // pages turned away by a full pool
+    uint32_t zs_loads;          // major faults: pages decompressed
+    uint64_t zs_load_cycles;    // ... and the time it took
+    uint32_t zs_pages;          // pages in the pool now
+    uint32_t zs_bytes;          // ... their compressed size
+    uint32_t zs_pool;           // ... and the slab objects holding them
+};
+
+extern struct Zswap_stats zswap_stats;
+extern uint32_t zswap_maxpool;
+
+/**
+ * Set up the pool.  Needs kmem_init().
+ */
+void zswap_init(void);
+
+/**
+ * @return  the pages of slab the pool's caches hold
+ */
+uint32_t zswap_slab_pages(void);
+
+/**
+ * Compress pp into the pool for nref PTEs.
+ * @return  its slot, -E_INVAL if it does not compress enough, or
+ *          -E_NO_MEM if the pool is full or off
+ */
+int zswap_store(struct Page *pp, int nref);
+
+/**
+ * Decompress a pooled page into pp.  The slot stays held.
+ * @param pte  a swap entry with PTE_ZSWAP
+ * @return  0
+ */
+int zswap_load(pte_t pte, struct Page *pp);
+
+/**
+ * One more PTE holds pte's slot.
+ * @return  0, or -E_NO_MEM if SWAP_MAXREF already do
+ */
+int zswap_dup(pte_t pte);
+
+/**
+ * One PTE fewer holds pte's slot, which is freed with the last.
+ */
+void zswap_drop(pte_t pte);
+
+#endif  // !_POTATOS_KERNEL_ZSWAP_H_
@@ -0,0 +1,80 @@
+#include <inc/lz4.h>
+
+/**
+ * Each LZ4 sequence is a token byte, a run of literals copied as is,
+ * and a match copied from earlier output:
+ *
+ *   token  [literal length...]  literals  offset(2)  [match length...]
+ *
+ * The high nibble of the token is the literal length and the low nibble
+ * the match length minus 4; a nibble of 15 continues in the following
+ * bytes, each adding its value until one is not 255.  The last sequence
+ * of a block stops after its literals.
+ */
+
+// Read the rest of a length whose token nibble was 15.
+static int lz4_length(const uint8_t **sp, const uint8_t *send, size_t *len) {
+    uint8_t b;
+    do {
+        if (*sp >= send) {
+            return -1;
+        }
+        b = *(*sp)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+int lz4_decompress(void *dst, size_t dstsize, const void *src, size_t srcsize) {
+    const uint8_t *s = src;
+    const uint8_t *send = s + srcsize;
+    uint8_t *d = dst;
+    uint8_t *dend = d + dstsize;
+    const uint8_t *m;
+    size_t len;
+    uint8_t token;
+
+    while (s < send) {
+        token = *s++;
+
+        // literals
+        len = token >> 4;
+        if (len == 15 && lz4_length(&s, send, &len) < 0) {
+            return -1;
+        }
+        if (len > (size_t) (send - s) || len > (size_t) (dend - d)) {
+            return -1;
+        }
+        for (; len > 0; --len) {
+            *d++ = *s++;
+        }
+        if (s == send) {
+            break;
+        }
+
+        // match; it may overlap the bytes it produces, so copy forward
+        // one byte at a time
+        if (send - s < 2) {
+            return -1;
+        }
+        len = s[0] | (s[1] << 8);
+        s += 2;
+        if (len == 0 || len > (size_t) (d - (uint8_t*) dst)) {
+            return -1;
+        }
+        m = d - len;
+
+        len = token & 15;
+        if (len == 15 && lz4_length(&s, send, &len) < 0) {
+            return -1;
+        }
+        len += 4;
+        if (len > (size_t) (dend - d)) {
+            return -1;
+        }
+        for (; len > 0; --len) {
+            *d++ = *m++;
+        }
+    }
+    return d - (uint8_t*) dst;
+}
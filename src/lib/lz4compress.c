@@ -0,0 +1,102 @@
+#include <inc/lz4.h>
+#include <inc/string.h>
+
+/**
+ * The same greedy matcher as src/boot/mklz4.py: hash each 4-byte window,
+ * and where the last window with that hash really matched, emit the
+ * literals since the previous match and extend the match as far as it
+ * goes.  Not as tight as the reference encoder, but quick, and every
+ * block it makes lib/lz4.c expands.
+ */
+
+#define LZ4_MINMATCH        4
+// The format wants the last match to start at least 12 bytes before the
+// end of the input and the last 5 bytes to be literals.
+#define LZ4_MFLIMIT         12
+#define LZ4_LASTLITERALS    5
+
+static uint32_t lz4_hash(const uint8_t *p) {
+    uint32_t v = p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+    return (v * 2654435761u) >> (32 - LZ4_HASHLOG);
+}
+
+// Bytes a length needs after its token nibble.
+static size_t lz4_lensize(size_t len) {
+    return len >= 15 ? (len - 15) / 255 + 1 : 0;
+}
+
+static uint8_t *lz4_putlen(uint8_t *d, size_t len) {
+    if (len < 15) {
+        return d;
+    }
+    for (len -= 15; len >= 255; len -= 255) {
+        *d++ = 255;
+    }
+    *d++ = len;
+    return d;
+}
+
+// Append a sequence, or the last one if mlen is 0.  Returns where the
+// next one goes, or NULL if this one would not fit before dend.
+static uint8_t *lz4_sequence(uint8_t *d, uint8_t *dend, const uint8_t *lit,
+                             size_t nlit, size_t offset, size_t mlen) {
+    size_t need = 1 + lz4_lensize(nlit) + nlit;
+
+    if (mlen) {
+        need += 2 + lz4_lensize(mlen - LZ4_MINMATCH);
+    }
+    if (need > (size_t) (dend - d)) {
+        return NULL;
+    }
+
+    *d++ = (nlit < 15 ? nlit : 15) << 4 |
+           (mlen == 0 ? 0 : mlen - LZ4_MINMATCH < 15 ? mlen - LZ4_MINMATCH : 15);
+    d = lz4_putlen(d, nlit);
+    memmove(d, lit, nlit);
+    d += nlit;
+    if (mlen) {
+        *d++ = offset & 0xff;
+        *d++ = offset >> 8;
+        d = lz4_putlen(d, mlen - LZ4_MINMATCH);
+    }
+    return d;
+}
+
+int lz4_compress(void *dst, size_t dstsize, const void *src, size_t srcsize,
+                 uint16_t *table) {
+    const uint8_t *s = src, *send = s + srcsize;
+    const uint8_t *p = s, *anchor = s, *ref;
+    uint8_t *d = dst, *dend = d + dstsize;
+    size_t mlen;
+    uint32_t h;
+
+    if (srcsize > LZ4_MAXINPUT) {
+        return -1;
+    }
+    // entries are offsets into src plus one, so 0 is empty
+    memset(table, 0, LZ4_HASHSIZE * sizeof(table[0]));
+
+    while (srcsize > LZ4_MFLIMIT && p < send - LZ4_MFLIMIT) {
+        h = lz4_hash(p);
+        ref = table[h] ? s + table[h] - 1 : NULL;
+        table[h] = p - s + 1;
+        if (!ref || memcmp(ref, p, LZ4_MINMATCH) != 0) {
+            ++p;
+            continue;
+        }
+
+        mlen = LZ4_MINMATCH;
+        while (p + mlen < send - LZ4_LASTLITERALS && ref[mlen] == p[mlen]) {
+            ++mlen;
+        }
+        if (!(d = lz4_sequence(d, dend, anchor, p - anchor, p - ref, mlen))) {
+            return -1;
+        }
+        p += mlen;
+        anchor = p;
+    }
+    if (!(d = lz4_sequence(d, dend, anchor, send - anchor, 0, 0))) {
+        return -1;
+    }
+    return d - (uint8_t *) dst;
+}